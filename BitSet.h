@@ -0,0 +1,39 @@
+#ifndef BITSET_H_6d1e0b83a4f2
+#define BITSET_H_6d1e0b83a4f2
+
+#include <cstdint>
+
+// Fixed size array of boolean flags, one bit per flag
+template <uint16_t N>
+class BitSet
+{
+    public:
+        BitSet()
+        {
+            this->SetAll(false);
+        }
+
+        void Set(uint16_t index, bool value)
+        {
+            if (value)
+                this->data[index / 8] |= (1 << (index % 8));
+            else
+                this->data[index / 8] &= ~(1 << (index % 8));
+        }
+
+        bool IsSet(uint16_t index) const
+        {
+            return this->data[index / 8] & (1 << (index % 8));
+        }
+
+        void SetAll(bool value)
+        {
+            for (uint16_t i = 0; i < sizeof(this->data); i++)
+                this->data[i] = value ? 0xFF : 0x00;
+        }
+
+    private:
+        uint8_t data[(N + 7) / 8];
+};
+
+#endif
@@ -0,0 +1,217 @@
+#include "CalibrationTable.h"
+#include "OneWire.h"
+
+extern "C"
+{
+    #include "nrf.h"
+    #include "nrf_assert.h"
+    #include "nrf_log.h"
+}
+
+FS_REGISTER_CFG(fs_config_t calibrationTableFsConfig) =
+{
+    DS18B20::CalibrationTable::FsEventHandlerStatic, // callback
+    1,                                               // num_pages
+    0xFC,                                            // priority
+    nullptr,                                         // p_start_addr (assigned by fs_init)
+    nullptr                                          // p_end_addr (assigned by fs_init)
+};
+
+static const uint16_t C_AddressesOffsetWords = DS18B20::CalibrationTable::C_HeaderLengthWords;
+static const uint16_t C_OffsetsOffsetWords = C_AddressesOffsetWords + 2 * DS18B20::CalibrationTable::C_MaxEntries;
+static const uint16_t C_OffsetsLengthWords = (DS18B20::CalibrationTable::C_MaxEntries + 1) / 2;
+
+DS18B20::CalibrationTable::CalibrationTable() : state(DS18B20::CalibrationTableState::Idle), isModified(false), count(0)
+{
+    for (uint8_t i = 0; i < C_MaxEntries; i++)
+    {
+        this->addresses[i] = 0;
+        this->offsets[i] = 0;
+    }
+}
+
+void DS18B20::CalibrationTable::Load()
+{
+    const uint32_t * page = calibrationTableFsConfig.p_start_addr;
+    if (page == nullptr || page[0] != C_Magic || page[1] > C_MaxEntries)
+        return;
+
+    uint8_t count = page[1];
+    const int16_t * offsets = reinterpret_cast<const int16_t *>(page + C_OffsetsOffsetWords);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        W1::BitBlock address;
+        address.FromUInt64(page[C_AddressesOffsetWords + 2 * i] | (static_cast<uint64_t>(page[C_AddressesOffsetWords + 2 * i + 1]) << 32), 0);
+        if (W1::Crc::Compute(address.Data, 7) != address.Data[7])
+        {
+            // erased or corrupted page
+            NRF_LOG_WARNING("Calibration table is corrupted\r\n");
+            return;
+        }
+    }
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        this->addresses[i] = page[C_AddressesOffsetWords + 2 * i] | (static_cast<uint64_t>(page[C_AddressesOffsetWords + 2 * i + 1]) << 32);
+        this->offsets[i] = offsets[i];
+    }
+    this->count = count;
+}
+
+int16_t DS18B20::CalibrationTable::GetOffset(uint64_t address)
+{
+    uint8_t count = this->count;
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (this->addresses[i] == address)
+            return this->offsets[i];
+    }
+    return 0;
+}
+
+bool DS18B20::CalibrationTable::SetOffset(uint64_t address, int16_t offset)
+{
+    uint8_t index = this->count;
+    uint8_t freeIndex = C_MaxEntries;
+    for (uint8_t i = 0; i < this->count; i++)
+    {
+        if (this->addresses[i] == address)
+        {
+            index = i;
+            break;
+        }
+        if (freeIndex == C_MaxEntries && this->offsets[i] == 0)
+        {
+            freeIndex = i;
+        }
+    }
+
+    if (index == this->count)
+    {
+        if (offset == 0)
+            return true;
+        if (freeIndex == C_MaxEntries && this->count == C_MaxEntries)
+            return false;
+
+        // free entry has offset 0, the offset becomes valid only after the address is complete
+        index = freeIndex < C_MaxEntries ? freeIndex : this->count;
+        this->addresses[index] = address;
+        __DMB();
+        if (index == this->count)
+        {
+            this->count = index + 1;
+        }
+    }
+    else if (this->offsets[index] == offset)
+    {
+        return true;
+    }
+    this->offsets[index] = offset;
+
+    if (this->state == DS18B20::CalibrationTableState::Idle)
+    {
+        this->state = DS18B20::CalibrationTableState::Erase;
+    }
+    else
+    {
+        this->isModified = true;
+    }
+    return true;
+}
+
+uint8_t DS18B20::CalibrationTable::GetCount()
+{
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < this->count; i++)
+    {
+        if (this->offsets[i] != 0)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+void DS18B20::CalibrationTable::DoWork()
+{
+    this->StartOperation();
+}
+
+// Queues the next flash operation of the write, it is retried by DoWork if the fstorage queue is full.
+// Whole arrays are stored (fixed layout), the header is stored last (marks valid content).
+void DS18B20::CalibrationTable::StartOperation()
+{
+    fs_ret_t res = FS_SUCCESS;
+    const uint32_t * page = calibrationTableFsConfig.p_start_addr;
+    DS18B20::CalibrationTableState startedState = this->state;
+    switch (startedState)
+    {
+    case DS18B20::CalibrationTableState::Erase:
+        this->isModified = false;
+        this->header[0] = C_Magic;
+        this->header[1] = this->count;
+        this->state = DS18B20::CalibrationTableState::Erasing;
+        res = fs_erase(&calibrationTableFsConfig, page, 1, this);
+        break;
+    case DS18B20::CalibrationTableState::StoreAddresses:
+        this->state = DS18B20::CalibrationTableState::StoringAddresses;
+        res = fs_store(&calibrationTableFsConfig, page + C_AddressesOffsetWords, reinterpret_cast<const uint32_t *>(this->addresses), 2 * C_MaxEntries, this);
+        break;
+    case DS18B20::CalibrationTableState::StoreOffsets:
+        this->state = DS18B20::CalibrationTableState::StoringOffsets;
+        res = fs_store(&calibrationTableFsConfig, page + C_OffsetsOffsetWords, reinterpret_cast<const uint32_t *>(this->offsets), C_OffsetsLengthWords, this);
+        break;
+    case DS18B20::CalibrationTableState::StoreHeader:
+        this->state = DS18B20::CalibrationTableState::StoringHeader;
+        res = fs_store(&calibrationTableFsConfig, page, this->header, C_HeaderLengthWords, this);
+        break;
+    default:
+        return;
+    }
+
+    if (res != FS_SUCCESS)
+    {
+        // fstorage queue is full (other module), try again later
+        this->state = startedState;
+        NRF_LOG_WARNING("Calibration table: flash operation not queued (%d)\r\n", res);
+    }
+}
+
+void DS18B20::CalibrationTable::FsEventHandlerStatic(fs_evt_t const * const evt, fs_ret_t result)
+{
+    static_cast<DS18B20::CalibrationTable *>(evt->p_context)->FsEventHandler(evt, result);
+}
+
+void DS18B20::CalibrationTable::FsEventHandler(fs_evt_t const * const evt, fs_ret_t result)
+{
+    if (result != FS_SUCCESS)
+    {
+        // the page is left without header (calibration would be lost after reset) => whole write is repeated
+        NRF_LOG_ERROR("Calibration table: flash operation failed (%d)\r\n", result);
+        this->state = DS18B20::CalibrationTableState::Erase;
+        return;
+    }
+
+    if (this->state == DS18B20::CalibrationTableState::Erasing && evt->id == FS_EVT_ERASE)
+    {
+        this->state = DS18B20::CalibrationTableState::StoreAddresses;
+    }
+    else if (this->state == DS18B20::CalibrationTableState::StoringAddresses && evt->id == FS_EVT_STORE)
+    {
+        this->state = DS18B20::CalibrationTableState::StoreOffsets;
+    }
+    else if (this->state == DS18B20::CalibrationTableState::StoringOffsets && evt->id == FS_EVT_STORE)
+    {
+        this->state = DS18B20::CalibrationTableState::StoreHeader;
+    }
+    else if (this->state == DS18B20::CalibrationTableState::StoringHeader && evt->id == FS_EVT_STORE && evt->store.p_data == this->header)
+    {
+        // table changed during the write is written again
+        this->state = this->isModified ? DS18B20::CalibrationTableState::Erase : DS18B20::CalibrationTableState::Idle;
+    }
+    else
+    {
+        return;
+    }
+    this->StartOperation();
+}
@@ -0,0 +1,60 @@
+#ifndef CALIBRATIONTABLE_H_9e31c5a08d74
+#define CALIBRATIONTABLE_H_9e31c5a08d74
+
+#include <cstdint>
+#include "app_global.h"
+
+extern "C"
+{
+#include "fstorage.h"
+}
+
+namespace DS18B20
+{
+    enum class CalibrationTableState
+    {
+        Idle,
+        Erase,          // table changed, operation waits for DoWork or for free fstorage queue (one operation is queued at a time)
+        Erasing,
+        StoreAddresses,
+        StoringAddresses,
+        StoreOffsets,
+        StoringOffsets,
+        StoreHeader,    // header is written last, it marks valid content
+        StoringHeader
+    };
+
+    // Temperature offsets of individual sensors (measured at commissioning) identified by ROM code, kept in a flash page (fstorage).
+    // Page layout (words): [0] magic, [1] entry count, [2..] addresses (2 words per address, lower word first), offsets (int16)
+    class CalibrationTable
+    {
+        public:
+            static const uint32_t C_Magic = 0x43414C31; // "CAL1"
+            static const uint16_t C_HeaderLengthWords = 2;
+            static const uint8_t C_MaxEntries = CALIBRATION_TABLE_SIZE;
+
+            CalibrationTable();
+            void Load(); // call after fs_init
+            int16_t GetOffset(uint64_t address); // [1/256 °C], 0 = sensor is not calibrated, safe to call from timeslot
+            // call from main loop, offset 0 removes calibration, false = table is full; the firmware has no inbound command
+            // channel (advertising only), offsets are written by a commissioning build or a future command path
+            bool SetOffset(uint64_t address, int16_t offset);
+            uint8_t GetCount();
+            void DoWork(); // call from main loop, stores changed table
+            static void FsEventHandlerStatic(fs_evt_t const * const evt, fs_ret_t result);
+
+        private:
+            void FsEventHandler(fs_evt_t const * const evt, fs_ret_t result);
+            void StartOperation();
+
+            volatile CalibrationTableState state;
+            volatile bool isModified; // changed while storing, has to be stored again
+            uint32_t header[C_HeaderLengthWords]; // must stay valid until fstorage completes the write
+            // entries with offset 0 are free, entry is written address first (timeslot never sees address with offset of other sensor)
+            uint64_t addresses[C_MaxEntries];
+            alignas(4) int16_t offsets[C_MaxEntries];
+            volatile uint8_t count;
+    };
+}
+
+#endif
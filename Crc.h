@@ -0,0 +1,27 @@
+#ifndef CRC_H_5b7e2c91d04a
+#define CRC_H_5b7e2c91d04a
+
+#include <cstdint>
+#include "app_global.h"
+
+namespace W1
+{
+    // Dallas/Maxim CRC-8 (x^8 + x^5 + x^4 + 1, ROM codes and scratchpads) and CRC-16 (x^16 + x^15 + x^2 + 1, e.g. DS2406, DS2450).
+    // Compute uses the variant selected by ONE_WIRE_CRC8_IMPLEMENTATION, unused tables are dropped by the linker (--gc-sections).
+    class Crc
+    {
+    public:
+        static uint8_t Compute(const uint8_t * data, uint16_t length);
+        static uint8_t ComputeTable256(const uint8_t * data, uint16_t length); // 256 B table, one lookup per byte
+        static uint8_t ComputeNibble(const uint8_t * data, uint16_t length);   // 16 B table, two lookups per byte
+        static uint8_t ComputeBitwise(const uint8_t * data, uint16_t length);  // no table, 8 shifts per byte
+        static uint8_t UpdateBit(uint8_t crc, bool bit); // CRC-8 of one more bit (LSB first, as bits are received)
+        static uint16_t Compute16(const uint8_t * data, uint16_t length, uint16_t crc = 0); // devices send inverted value (~crc)
+
+        static const uint8_t lookupTable[];
+        static const uint8_t nibbleTable[];
+        static const uint8_t oddParityTable[];
+    };
+}
+
+#endif
@@ -6,10 +6,24 @@ extern "C"
 #include "nrf_log.h"
 }
 
-DS18B20::Driver::Driver(TS::TimeslotManager &timeslotManager, W1::OneWireBus &bus, SupplyBranchHandle supplyBranch)
-    : timeslotManager(timeslotManager), oneWireBus(bus), sensorsCount(0), isConversionCompleted(false),
-      state(DS18B20::DriverState::Init), searchRomHelper(bus), supplyBranch(supplyBranch)
+DS18B20::Driver::Driver(TS::TimeslotManager &timeslotManager, W1::OneWireBus &bus, SupplyBranchHandle supplyBranch, W1::RomCodeCache *romCodeCache,
+                         DS18B20::CalibrationTable *calibrationTable)
+    : timeslotManager(timeslotManager), oneWireBus(bus), sensorsCount(0), readRetryCount(0), conversionWaitUs(0), conversionTimeUs(0), isConversionCompleted(false), isParasitePowered(false), isResolutionWritten(false),
+      state(DS18B20::DriverState::Init), searchRomHelper(bus, *this), supplyBranch(supplyBranch), romCodeCache(romCodeCache), calibrationTable(calibrationTable),
+      isSensorListFromCache(false), isConversionRequested(false), isConfigurationRequested(false), isSensorAdded(false), cyclesSinceRescan(0),
+      readoutMode(DS18B20::ReadoutMode::AllSensors), resolutionPolicy(DS18B20::ResolutionPolicy::Fixed),
+      cycle(0), cycleStartTime(0)
 {
+    this->searchLane = 0;
+    this->isSearchComplete = true;
+    for (uint8_t slot = 0; slot < C_LockstepSlotCount; slot++)
+    {
+        for (uint8_t lane = 0; lane < W1::OneWirePhysicalLayer::C_MaxLanes; lane++)
+        {
+            this->lockstepSensors[slot][lane] = C_NoSensor;
+        }
+    }
+    bus.SetTransactionListener(this);
     timeslotManager.AddTask(this);
 }
 
@@ -18,9 +32,70 @@ bool DS18B20::Driver::IsReady()
     return this->state == DS18B20::DriverState::Idle;
 }
 
-const DS18B20::TemperatureInfo *DS18B20::Driver::GetResult()
+DS18B20::TemperatureInfo DS18B20::Driver::GetResult(uint8_t sensorIndex)
+{
+    ASSERT(sensorIndex < this->sensorsCount);
+    DS18B20::TemperatureInfo info;
+    info.address = this->addresses[sensorIndex];
+    info.timestamp = this->timestamps[sensorIndex];
+    info.rawTemperature = this->temperatures[sensorIndex];
+    info.dataValid = this->isDataValid.IsSet(sensorIndex);
+    info.isAlarm = this->isAlarm.IsSet(sensorIndex);
+    return info;
+}
+
+uint32_t DS18B20::Driver::GetSnapshotCycle(uint8_t &sensorsCount, uint32_t &cycleStartTime)
+{
+    uint32_t cycle;
+    uint32_t sequence;
+    do
+    {
+        sequence = this->snapshot.BeginRead();
+        const DS18B20::MeasurementSnapshot & snapshot = this->snapshot.GetValue();
+        cycle = snapshot.cycle;
+        sensorsCount = snapshot.sensorsCount;
+        cycleStartTime = snapshot.cycleStartTime;
+    } while (!this->snapshot.EndRead(sequence));
+    return cycle;
+}
+
+bool DS18B20::Driver::GetSnapshotResult(uint32_t cycle, uint8_t sensorIndex, DS18B20::TemperatureInfo &info)
 {
-    return this->sensors;
+    uint32_t sequence;
+    bool isSameCycle;
+    do
+    {
+        sequence = this->snapshot.BeginRead();
+        const DS18B20::MeasurementSnapshot & snapshot = this->snapshot.GetValue();
+        isSameCycle = snapshot.cycle == cycle && sensorIndex < snapshot.sensorsCount;
+        if (isSameCycle)
+        {
+            info.address = snapshot.addresses[sensorIndex];
+            info.timestamp = snapshot.timestamps[sensorIndex];
+            info.rawTemperature = snapshot.temperatures[sensorIndex];
+            info.dataValid = snapshot.isDataValid.IsSet(sensorIndex);
+            info.isAlarm = snapshot.isAlarm.IsSet(sensorIndex);
+        }
+    } while (!this->snapshot.EndRead(sequence));
+    return isSameCycle;
+}
+
+// Called from timeslot when all results of the cycle are stored
+void DS18B20::Driver::PublishSnapshot()
+{
+    DS18B20::MeasurementSnapshot & snapshot = this->snapshot.BeginWrite();
+    snapshot.cycle = ++this->cycle;
+    snapshot.cycleStartTime = this->cycleStartTime;
+    snapshot.sensorsCount = this->sensorsCount;
+    for (uint8_t i = 0; i < this->sensorsCount; i++)
+    {
+        snapshot.addresses[i] = this->addresses[i];
+        snapshot.timestamps[i] = this->timestamps[i];
+        snapshot.temperatures[i] = this->temperatures[i];
+        snapshot.isDataValid.Set(i, this->isDataValid.IsSet(i));
+        snapshot.isAlarm.Set(i, this->isAlarm.IsSet(i));
+    }
+    this->snapshot.EndWrite();
 }
 
 uint8_t DS18B20::Driver::GetSensorsCount()
@@ -30,10 +105,111 @@ uint8_t DS18B20::Driver::GetSensorsCount()
 
 void DS18B20::Driver::StartConversion()
 {
-    ASSERT(this->IsReady());
-    this->state = DS18B20::DriverState::BeforeConversion;
     this->isConversionCompleted = false;
-    this->timeslotManager.RequestTimeslot(this);
+    if (this->IsReady())
+    {
+        this->state = DS18B20::DriverState::BeforeConversion;
+        this->timeslotManager.RequestTimeslot(this);
+    }
+    else
+    {
+        // driver is busy (initialization, background search), conversion is started as soon as it is done
+        this->isConversionRequested = true;
+    }
+}
+
+// Goes to idle state or starts conversion requested while the driver was busy
+void DS18B20::Driver::EnterIdleState()
+{
+    if (this->isConversionRequested)
+    {
+        this->isConversionRequested = false;
+        this->state = DS18B20::DriverState::BeforeConversion;
+    }
+    else
+    {
+        this->state = DS18B20::DriverState::Idle;
+    }
+}
+
+// Starts background search of the bus every C_RescanIntervalCycles measurements (detects added and removed sensors)
+bool DS18B20::Driver::StartRescanIfDue()
+{
+    if (C_RescanIntervalCycles == 0 || ++this->cyclesSinceRescan < C_RescanIntervalCycles)
+        return false;
+
+    this->cyclesSinceRescan = 0;
+    this->isFound.SetAll(false);
+    this->isSensorAdded = false;
+    this->state = DS18B20::DriverState::Rescan;
+    this->StartSearch();
+    return true;
+}
+
+// Called by SearchRomHelper for each found device (Search ROM, background search and Alarm Search)
+void DS18B20::Driver::OnDeviceFound(uint64_t address)
+{
+    if (W1::DeviceFamilyRegistry::Find(address) == W1::DeviceFamilyRegistry::C_UnknownFamily)
+    {
+        NRF_LOG_INFO("Unsupported device: %x %x\r\n", static_cast<uint32_t>(address >> 32), static_cast<uint32_t>(address));
+        return;
+    }
+
+    if (this->state == DS18B20::DriverState::SearchRom)
+    {
+        if (this->sensorsCount < W1::SearchRomHelper::C_maxDeviceCount)
+        {
+            this->lanes[this->sensorsCount] = this->searchLane;
+            this->InitSensor(this->sensorsCount++, address);
+        }
+    }
+    else if (this->state == DS18B20::DriverState::Rescan)
+    {
+        // sensors found again keep their values, new sensors are appended
+        uint8_t sensorIndex = this->FindSensor(address);
+        if (sensorIndex < this->sensorsCount)
+        {
+            this->isFound.Set(sensorIndex, true);
+            this->lanes[sensorIndex] = this->searchLane; // sensor may be reconnected to another lane
+        }
+        else if (this->sensorsCount < W1::SearchRomHelper::C_maxDeviceCount)
+        {
+            NRF_LOG_INFO("Sensor added: %x %x\r\n", static_cast<uint32_t>(address >> 32), static_cast<uint32_t>(address));
+            this->lanes[this->sensorsCount] = this->searchLane;
+            this->InitSensor(this->sensorsCount, address);
+            this->isFound.Set(this->sensorsCount++, true);
+            this->isSensorAdded = true;
+        }
+    }
+    else if (this->state == DS18B20::DriverState::AlarmSearch)
+    {
+        uint8_t sensorIndex = this->FindSensor(address);
+        if (sensorIndex < this->sensorsCount)
+        {
+            this->isAlarm.Set(sensorIndex, true);
+        }
+    }
+}
+
+// Removes sensors not found by completed background search, returns true if any sensor was removed
+bool DS18B20::Driver::RemoveMissingSensors()
+{
+    uint8_t keptCount = 0;
+    for (uint8_t i = 0; i < this->sensorsCount; i++)
+    {
+        if (this->isFound.IsSet(i))
+        {
+            this->MoveSensor(i, keptCount++);
+        }
+        else
+        {
+            NRF_LOG_INFO("Sensor removed: %x %x\r\n", static_cast<uint32_t>(this->addresses[i] >> 32), static_cast<uint32_t>(this->addresses[i]));
+        }
+    }
+
+    bool isChanged = keptCount != this->sensorsCount;
+    this->sensorsCount = keptCount;
+    return isChanged;
 }
 
 bool DS18B20::Driver::IsConversionCompleted()
@@ -41,9 +217,153 @@ bool DS18B20::Driver::IsConversionCompleted()
     return this->isConversionCompleted;
 }
 
+// Thresholds are written to the sensor (scratchpad and EEPROM) before the next conversion
+void DS18B20::Driver::SetAlarmThresholds(uint8_t sensorIndex, int8_t alarmLow, int8_t alarmHigh)
+{
+    ASSERT(sensorIndex < this->sensorsCount);
+    this->alarmLow[sensorIndex] = alarmLow;
+    this->alarmHigh[sensorIndex] = alarmHigh;
+    if (this->GetFamily(sensorIndex).configurationLength > 0)
+    {
+        this->isConfigurationPending.Set(sensorIndex, true);
+        this->isConfigurationRequested = true;
+    }
+}
+
+void DS18B20::Driver::SetReadoutMode(DS18B20::ReadoutMode mode)
+{
+    this->readoutMode = mode;
+}
+
+void DS18B20::Driver::SetResolution(uint8_t sensorIndex, DS18B20::SensorResolution resolution)
+{
+    ASSERT(sensorIndex < this->sensorsCount);
+    if (this->resolutions[sensorIndex] != resolution)
+    {
+        this->resolutions[sensorIndex] = resolution;
+        this->isResolutionPending.Set(sensorIndex, this->GetFamily(sensorIndex).configurationLength >= 3);
+    }
+}
+
+DS18B20::SensorResolution DS18B20::Driver::GetResolution(uint8_t sensorIndex)
+{
+    ASSERT(sensorIndex < this->sensorsCount);
+    return this->resolutions[sensorIndex];
+}
+
+void DS18B20::Driver::SetResolutionPolicy(DS18B20::ResolutionPolicy policy)
+{
+    this->resolutionPolicy = policy;
+}
+
+DS18B20::SensorErrorCounters DS18B20::Driver::GetErrorCounters(uint8_t sensorIndex)
+{
+    ASSERT(sensorIndex < this->sensorsCount);
+    return this->errorCounters[sensorIndex];
+}
+
+bool DS18B20::Driver::IsParasitePowered()
+{
+    return this->isParasitePowered;
+}
+
+void DS18B20::Driver::InitSensor(uint8_t sensorIndex, uint64_t address)
+{
+    this->addresses[sensorIndex] = address;
+    this->families[sensorIndex] = W1::DeviceFamilyRegistry::Find(address);
+    this->temperatures[sensorIndex] = 0;
+    this->timestamps[sensorIndex] = 0;
+    this->alarmHigh[sensorIndex] = C_DefaultAlarmHigh;
+    this->alarmLow[sensorIndex] = C_DefaultAlarmLow;
+    this->resolutions[sensorIndex] = C_SensorResolution;
+    this->eepromResolutions[sensorIndex] = C_SensorResolution; // read by the sensors check
+    this->stableCycles[sensorIndex] = 0;
+    this->errorCounters[sensorIndex].crcErrors = 0;
+    this->errorCounters[sensorIndex].missing = 0;
+    this->errorCounters[sensorIndex].powerOnValues = 0;
+    this->isDataValid.Set(sensorIndex, false);
+    this->isAlarm.Set(sensorIndex, false);
+    this->isConfigurationPending.Set(sensorIndex, false);
+    this->isResolutionPending.Set(sensorIndex, false);
+    this->isResolutionUnconfirmed.Set(sensorIndex, false);
+    this->isReconversionPending.Set(sensorIndex, false);
+    this->isReconverted.Set(sensorIndex, false);
+}
+
+void DS18B20::Driver::MoveSensor(uint8_t fromIndex, uint8_t toIndex)
+{
+    if (fromIndex == toIndex)
+        return;
+
+    this->addresses[toIndex] = this->addresses[fromIndex];
+    this->families[toIndex] = this->families[fromIndex];
+    this->lanes[toIndex] = this->lanes[fromIndex];
+    this->temperatures[toIndex] = this->temperatures[fromIndex];
+    this->timestamps[toIndex] = this->timestamps[fromIndex];
+    this->alarmHigh[toIndex] = this->alarmHigh[fromIndex];
+    this->alarmLow[toIndex] = this->alarmLow[fromIndex];
+    this->resolutions[toIndex] = this->resolutions[fromIndex];
+    this->eepromResolutions[toIndex] = this->eepromResolutions[fromIndex];
+    this->stableCycles[toIndex] = this->stableCycles[fromIndex];
+    this->errorCounters[toIndex] = this->errorCounters[fromIndex];
+    this->isDataValid.Set(toIndex, this->isDataValid.IsSet(fromIndex));
+    this->isAlarm.Set(toIndex, this->isAlarm.IsSet(fromIndex));
+    this->isConfigurationPending.Set(toIndex, this->isConfigurationPending.IsSet(fromIndex));
+    this->isResolutionPending.Set(toIndex, this->isResolutionPending.IsSet(fromIndex));
+    this->isResolutionUnconfirmed.Set(toIndex, this->isResolutionUnconfirmed.IsSet(fromIndex));
+    this->isReconversionPending.Set(toIndex, this->isReconversionPending.IsSet(fromIndex));
+    this->isReconverted.Set(toIndex, this->isReconverted.IsSet(fromIndex));
+    this->isFound.Set(toIndex, this->isFound.IsSet(fromIndex));
+}
+
+// Returns sensorsCount if the address is unknown
+uint8_t DS18B20::Driver::FindSensor(uint64_t address)
+{
+    uint8_t i = 0;
+    while (i < this->sensorsCount && this->addresses[i] != address)
+        i++;
+    return i;
+}
+
+const W1::DeviceFamily &DS18B20::Driver::GetFamily(uint8_t sensorIndex)
+{
+    return W1::DeviceFamilyRegistry::Get(this->families[sensorIndex]);
+}
+
+// First read byte (after MatchRom, address and read command)
+uint8_t DS18B20::Driver::GetReadOffset(uint8_t sensorIndex)
+{
+    return 1 + 8 + this->GetFamily(sensorIndex).readCommandLength;
+}
+
+const uint8_t *DS18B20::Driver::GetScratchpad(uint8_t sensorIndex)
+{
+    return this->oneWireBus.GetReceivedData(this->lanes[sensorIndex]).Data + this->GetReadOffset(sensorIndex);
+}
+
+// Longest conversion time of all sensors on the bus (conversion is started by single broadcast)
 uint32_t DS18B20::Driver::GetConversionTimeUs()
 {
-    switch (C_SensorResolution)
+    uint32_t conversionTimeUs = 0;
+    for (uint8_t i = 0; i < this->sensorsCount; i++)
+    {
+        uint32_t sensorConversionTimeUs = this->GetConversionTimeUs(i);
+        if (sensorConversionTimeUs > conversionTimeUs)
+            conversionTimeUs = sensorConversionTimeUs;
+    }
+    return conversionTimeUs;
+}
+
+uint32_t DS18B20::Driver::GetConversionTimeUs(uint8_t sensorIndex)
+{
+    const W1::DeviceFamily & family = this->GetFamily(sensorIndex);
+    if (family.configurationLength < 3)
+        return family.conversionTimeUs;
+
+    // resolution is set by configuration register, its content is not known until the write is read back
+    if (this->isResolutionPending.IsSet(sensorIndex) || this->isResolutionUnconfirmed.IsSet(sensorIndex))
+        return 750 * 1000;
+    switch (this->resolutions[sensorIndex])
     {
     case DS18B20::SensorResolution::Bits9:
         return 94 * 1000;
@@ -57,6 +377,12 @@ uint32_t DS18B20::Driver::GetConversionTimeUs()
     }
 }
 
+// Typical conversion time of a sensor (datasheet gives only the maximum). Conversion-done polling starts after this time.
+uint32_t DS18B20::Driver::GetMinConversionTimeUs()
+{
+    return this->conversionTimeUs / 8 * 5;
+}
+
 bool DS18B20::Driver::SetSupplyBranchState()
 {
     if (this->IsReady())
@@ -64,28 +390,645 @@ bool DS18B20::Driver::SetSupplyBranchState()
         supplyBranch.Release();
         return false;
     }
+    else if (supplyBranch.Request())
+    {
+        this->OnSensorsPoweredUp();
+        return true;
+    }
+    return false;
+}
+
+// Sensors load the configuration register from EEPROM at power-up, resolution kept only in the scratchpad (adaptive
+// policy) has to be written again before the next Convert T.
+void DS18B20::Driver::OnSensorsPoweredUp()
+{
+    this->isResolutionWritten = false;
+    for (uint8_t i = 0; i < this->sensorsCount; i++)
+    {
+        if (this->GetFamily(i).configurationLength >= 3 && this->resolutions[i] != this->eepromResolutions[i])
+        {
+            this->isResolutionPending.Set(i, true);
+        }
+    }
+}
+
+// Reads all sensors selected by FindNextReadout. Reads are queued on the bus and executed back-to-back,
+// results are processed by OnTransactionCompleted which keeps the queue filled.
+void DS18B20::Driver::StartResultsRead()
+{
+    this->currentSensorIndex = this->FindNextReadout(0);
+    if (this->currentSensorIndex < this->sensorsCount)
+    {
+        this->state = DS18B20::DriverState::ReadResult;
+        for (uint8_t lane = 0; lane < this->oneWireBus.GetLaneCount(); lane++)
+        {
+            this->laneReadIndex[lane] = this->FindNextLaneReadout(lane, 0);
+        }
+        this->EnqueueResultsRead();
+    }
     else
     {
-        return supplyBranch.Request();
+        // nothing to read (no sensor in alarm state, ID only devices)
+        this->CompleteConversion();
     }
 }
 
-void DS18B20::Driver::ReadResult(uint8_t sensorIndex)
+void DS18B20::Driver::EnqueueResultsRead()
 {
+    if (this->oneWireBus.GetLaneCount() > 1)
+    {
+        this->EnqueueLockstepReads();
+        return;
+    }
+
+    while (this->currentSensorIndex < this->sensorsCount &&
+           this->oneWireBus.GetQueueFreeCount() >= (this->GetFamily(this->currentSensorIndex).recallCommandLength ? 2 : 1))
+    {
+        this->EnqueueResultRead(this->currentSensorIndex, 0);
+        this->currentSensorIndex = this->FindNextReadout(this->currentSensorIndex + 1);
+    }
+}
+
+// Families with recall command copy their data to scratchpad first (not repeated on retry)
+void DS18B20::Driver::EnqueueResultRead(uint8_t sensorIndex, uint8_t retryCount)
+{
+    const W1::DeviceFamily & family = this->GetFamily(sensorIndex);
+    W1::OneWireTransaction transaction;
+    if (family.recallCommandLength && retryCount == 0)
+    {
+        this->PrepareTransaction(transaction, sensorIndex, family.recallCommand, family.recallCommandLength);
+        transaction.tag = C_RecallTag | sensorIndex;
+        this->oneWireBus.Enqueue(transaction);
+    }
+
+    // read whole scratchpad (CRC is checked)
+    this->PrepareTransaction(transaction, sensorIndex, family.readCommand, family.readCommandLength);
+    transaction.readLength = family.readLength * 8;
+    transaction.tag = (retryCount << 8) | sensorIndex;
+    this->oneWireBus.Enqueue(transaction);
+}
+
+// Multi-lane bus: one transaction reads the next sensor of each lane at once (lanes are driven in lockstep, conversion
+// was started on all lanes by one broadcast), so the readout takes as long as the lane with most sensors, not the sum.
+// The lowest pending sensor is the reference, lanes whose next sensor needs another read command wait for a later
+// transaction. Sensors with recall command are read alone.
+void DS18B20::Driver::EnqueueLockstepReads()
+{
+    while (this->currentSensorIndex < this->sensorsCount &&
+           this->oneWireBus.GetQueueFreeCount() >= (this->GetFamily(this->currentSensorIndex).recallCommandLength ? 2 : 1))
+    {
+        uint8_t referenceIndex = this->currentSensorIndex;
+        if (this->GetFamily(referenceIndex).recallCommandLength)
+        {
+            uint8_t lane = this->lanes[referenceIndex];
+            this->EnqueueResultRead(referenceIndex, 0);
+            this->laneReadIndex[lane] = this->FindNextLaneReadout(lane, referenceIndex + 1);
+        }
+        else
+        {
+            uint8_t slot = this->FindFreeLockstepSlot();
+            for (uint8_t lane = 0; lane < this->oneWireBus.GetLaneCount(); lane++)
+            {
+                uint8_t sensorIndex = this->laneReadIndex[lane];
+                if (sensorIndex < this->sensorsCount && this->IsLockstepCompatible(referenceIndex, sensorIndex))
+                {
+                    this->lockstepSensors[slot][lane] = sensorIndex;
+                    this->laneReadIndex[lane] = this->FindNextLaneReadout(lane, sensorIndex + 1);
+                }
+            }
+            this->EnqueueLockstepRead(slot, 0);
+        }
+
+        this->currentSensorIndex = this->sensorsCount;
+        for (uint8_t lane = 0; lane < this->oneWireBus.GetLaneCount(); lane++)
+        {
+            if (this->laneReadIndex[lane] < this->currentSensorIndex)
+            {
+                this->currentSensorIndex = this->laneReadIndex[lane];
+            }
+        }
+    }
+}
+
+// Match ROM with own address on each lane of the slot, read command and length are shared
+void DS18B20::Driver::EnqueueLockstepRead(uint8_t slot, uint8_t retryCount)
+{
+    W1::OneWireTransaction transaction;
+    transaction.writeLength = 0;
+    for (uint8_t lane = 0; lane < this->oneWireBus.GetLaneCount(); lane++)
+    {
+        uint8_t sensorIndex = this->lockstepSensors[slot][lane];
+        if (sensorIndex == C_NoSensor)
+            continue;
+
+        if (transaction.writeLength == 0)
+        {
+            const W1::DeviceFamily & family = this->GetFamily(sensorIndex);
+            this->PrepareTransaction(transaction, sensorIndex, family.readCommand, family.readCommandLength);
+            transaction.readLength = family.readLength * 8;
+        }
+        transaction.SetLaneAddress(lane, this->addresses[sensorIndex]);
+    }
+    transaction.tag = C_LockstepTag | (retryCount << 8) | slot;
+    this->oneWireBus.Enqueue(transaction);
+}
+
+// Results of all lanes are stored, sensors with CRC error stay in the slot and are read again together
+void DS18B20::Driver::OnLockstepReadCompleted(uint8_t slot, uint8_t retryCount)
+{
+    bool isRetryNeeded = false;
+    for (uint8_t lane = 0; lane < this->oneWireBus.GetLaneCount(); lane++)
+    {
+        uint8_t sensorIndex = this->lockstepSensors[slot][lane];
+        if (sensorIndex == C_NoSensor)
+            continue;
+
+        bool isValid = this->IsScratchpadValid(sensorIndex);
+        if (!isValid)
+        {
+            this->CountReadError(sensorIndex);
+            if (retryCount < C_ReadRetryCount)
+            {
+                isRetryNeeded = true;
+                continue;
+            }
+        }
+        this->StoreResult(sensorIndex, isValid);
+        this->lockstepSensors[slot][lane] = C_NoSensor;
+    }
+
+    if (isRetryNeeded)
+    {
+        // the completed transaction released its queue slot
+        this->EnqueueLockstepRead(slot, retryCount + 1);
+        return;
+    }
+    this->EnqueueResultsRead();
+}
+
+// Slot with no sensor on any lane (at most C_QueueLength queued transactions and the running one use slots)
+uint8_t DS18B20::Driver::FindFreeLockstepSlot()
+{
+    for (uint8_t slot = 0; slot < C_LockstepSlotCount; slot++)
+    {
+        uint8_t lane = 0;
+        while (lane < this->oneWireBus.GetLaneCount() && this->lockstepSensors[slot][lane] == C_NoSensor)
+            lane++;
+        if (lane == this->oneWireBus.GetLaneCount())
+            return slot;
+    }
+    ASSERT(false);
+    return 0;
+}
+
+// Sensor can be read by the same transaction as the reference sensor (e.g. DS18B20 and DS18S20)
+bool DS18B20::Driver::IsLockstepCompatible(uint8_t referenceIndex, uint8_t sensorIndex)
+{
+    const W1::DeviceFamily & reference = this->GetFamily(referenceIndex);
+    const W1::DeviceFamily & family = this->GetFamily(sensorIndex);
+    if (family.recallCommandLength || family.readLength != reference.readLength || family.readCommandLength != reference.readCommandLength)
+        return false;
+
+    for (uint8_t i = 0; i < family.readCommandLength; i++)
+    {
+        if (family.readCommand[i] != reference.readCommand[i])
+            return false;
+    }
+    return true;
+}
+
+// Reset, Match ROM and command, no read
+void DS18B20::Driver::PrepareTransaction(W1::OneWireTransaction &transaction, uint8_t sensorIndex, const uint8_t *command, uint8_t length)
+{
+    ASSERT(9 + length <= W1::OneWireTransaction::C_MaxWriteBytes);
+    transaction.reset = true;
+    transaction.writeData[0] = W1::RomCommand::MatchRom;
+    for (uint8_t i = 0; i < 8; i++)
+    {
+        transaction.writeData[1 + i] = (this->addresses[sensorIndex] >> (8 * i)) & 0xFF;
+    }
+    for (uint8_t i = 0; i < length; i++)
+    {
+        transaction.writeData[9 + i] = command[i];
+    }
+    transaction.writeLength = 9 + length;
+    transaction.readLength = 0;
+    transaction.laneMask = 0;
+}
+
+void DS18B20::Driver::OnTransactionCompleted(uint16_t tag)
+{
+    if (tag & C_RecallTag)
+        return;
+
+    uint8_t retryCount = (tag >> 8) & 0x3F;
+    if (tag & C_LockstepTag)
+    {
+        this->OnLockstepReadCompleted(tag & 0xFF, retryCount);
+        return;
+    }
+
+    uint8_t sensorIndex = tag & 0xFF;
+    bool isValid = this->IsScratchpadValid(sensorIndex);
+    if (!isValid)
+    {
+        this->CountReadError(sensorIndex);
+    }
+    if (!isValid && retryCount < C_ReadRetryCount)
+    {
+        // the completed transaction released its queue slot
+        this->EnqueueResultRead(sensorIndex, retryCount + 1);
+        return;
+    }
+
+    this->StoreResult(sensorIndex, isValid);
+    this->EnqueueResultsRead();
+}
+
+// Missing device (or line stuck high) reads all ones
+void DS18B20::Driver::CountReadError(uint8_t sensorIndex)
+{
+    const uint8_t * data = this->GetScratchpad(sensorIndex);
+    uint8_t ones = 0xFF;
+    for (uint8_t i = 0; i < this->GetFamily(sensorIndex).readLength; i++)
+    {
+        ones &= data[i];
+    }
+    if (!this->oneWireBus.IsSlavePresent(this->lanes[sensorIndex]) || ones == 0xFF)
+        this->errorCounters[sensorIndex].missing++;
+    else
+        this->errorCounters[sensorIndex].crcErrors++;
+}
+
+void DS18B20::Driver::StoreResult(uint8_t sensorIndex, bool isValid)
+{
+    const W1::DeviceFamily & family = this->GetFamily(sensorIndex);
+    const uint8_t * scratchpad = this->GetScratchpad(sensorIndex);
+    if (isValid && this->IsSentinelValue(sensorIndex, scratchpad))
+    {
+        isValid = false;
+    }
+
+    if (isValid)
+    {
+        int16_t temperature = family.decodeTemperature(scratchpad);
+        int16_t offset = this->calibrationTable ? this->calibrationTable->GetOffset(this->addresses[sensorIndex]) : 0;
+        if (family.configurationLength >= 3)
+        {
+            // write of the configuration register is confirmed (or repeated) by the readout
+            bool isResolutionUpToDate = this->IsResolutionUpToDate(sensorIndex);
+            this->isResolutionUnconfirmed.Set(sensorIndex, false);
+            this->isResolutionPending.Set(sensorIndex, this->isResolutionPending.IsSet(sensorIndex) || !isResolutionUpToDate);
+
+            // undefined low bits at lower resolution (LSB = 1/16 °C << (3 - R))
+            uint8_t resolution = (scratchpad[DS18B20::Scratchpad::Configuration] >> 5) & 0x03;
+            temperature &= ~((16 << (3 - resolution)) - 1);
+            if (this->resolutionPolicy == DS18B20::ResolutionPolicy::Adaptive)
+            {
+                this->UpdateResolution(sensorIndex, temperature, offset, this->isDataValid.IsSet(sensorIndex));
+            }
+        }
+        // same rule as the sensor uses for alarm flag (integer part of uncalibrated temperature compared with TH/TL)
+        int8_t temperatureInteger = temperature >> 8;
+        this->isAlarm.Set(sensorIndex, family.configurationLength >= 2 &&
+                                       (temperatureInteger >= this->alarmHigh[sensorIndex] || temperatureInteger <= this->alarmLow[sensorIndex]));
+        int32_t calibrated = temperature + offset;
+        temperature = calibrated > INT16_MAX ? INT16_MAX : calibrated < INT16_MIN ? INT16_MIN : calibrated;
+        this->temperatures[sensorIndex] = temperature;
+        this->timestamps[sensorIndex] = MonotonicClock::Now();
+    }
+    // else: sensor keeps the last temperature, which is marked as not up to date
+    this->isDataValid.Set(sensorIndex, isValid);
+}
+
+// Power-on value (conversion was interrupted), the sensor is converted again within the cycle (once). All ones
+// temperature is not a sentinel with valid CRC (-0.0625 °C), missing device is detected by OnTransactionCompleted.
+bool DS18B20::Driver::IsSentinelValue(uint8_t sensorIndex, const uint8_t *data)
+{
+    const W1::DeviceFamily & family = this->GetFamily(sensorIndex);
+    if (family.isPowerOnValue && family.isPowerOnValue(data))
+    {
+        this->errorCounters[sensorIndex].powerOnValues++;
+        this->isReconversionPending.Set(sensorIndex, !this->isReconverted.IsSet(sensorIndex));
+        return true;
+    }
+    return false;
+}
+
+uint8_t DS18B20::Driver::FindPendingReconversion(uint8_t firstSensorIndex)
+{
+    uint8_t i = firstSensorIndex;
+    while (i < this->sensorsCount && !this->isReconversionPending.IsSet(i))
+        i++;
+    return i;
+}
+
+// Convert T addressed to single sensor (other sensors keep their results)
+void DS18B20::Driver::StartReconversion(uint8_t sensorIndex)
+{
+    this->isReconversionPending.Set(sensorIndex, false);
+    this->isReconverted.Set(sensorIndex, true);
+    this->state = DS18B20::DriverState::Reconversion;
+    if (this->isParasitePowered)
+    {
+        this->oneWireBus.RequestStrongPullUp();
+    }
+    this->SendCommand(sensorIndex, &this->GetFamily(sensorIndex).convertCommand, 1);
+}
+
+// Adaptive resolution: 12 bits while the temperature is changing or is close to TH/TL, 9 bits (1/8 of conversion time)
+// after C_StableCycles cycles without change. New resolution is used from the next conversion.
+// Temperature is uncalibrated (TH/TL comparison), the change is computed with the offset of the stored (calibrated) value.
+void DS18B20::Driver::UpdateResolution(uint8_t sensorIndex, int16_t temperature, int16_t offset, bool isPreviousValid)
+{
+    int32_t change = static_cast<int32_t>(temperature) + offset - this->temperatures[sensorIndex];
+    int8_t temperatureInteger = temperature >> 8;
+    bool hasThresholds = this->alarmHigh[sensorIndex] > this->alarmLow[sensorIndex]; // TH = TL => alarm is always active
+    bool isNearAlarm = hasThresholds && (temperatureInteger >= this->alarmHigh[sensorIndex] - C_AlarmMargin ||
+                                         temperatureInteger <= this->alarmLow[sensorIndex] + C_AlarmMargin);
+
+    DS18B20::SensorResolution resolution = this->resolutions[sensorIndex];
+    if (!isPreviousValid || change > C_StableDelta || change < -C_StableDelta || isNearAlarm)
+    {
+        this->stableCycles[sensorIndex] = 0;
+        resolution = DS18B20::SensorResolution::Bits12;
+    }
+    else if (this->stableCycles[sensorIndex] < C_StableCycles)
+    {
+        this->stableCycles[sensorIndex]++;
+    }
+    else
+    {
+        resolution = DS18B20::SensorResolution::Bits9;
+    }
+
+    if (resolution != this->resolutions[sensorIndex])
+    {
+        this->resolutions[sensorIndex] = resolution;
+        this->isResolutionPending.Set(sensorIndex, true);
+    }
+}
+
+void DS18B20::Driver::ReadScratchpad(uint8_t sensorIndex, uint8_t length)
+{
+    const W1::DeviceFamily & family = this->GetFamily(sensorIndex);
     W1::BitBlock writeData;
     W1::BitBlock writeMask;
-    writeData.Data[0] = W1::RomCommand::MatchRom;                // [0]
-    writeData.FromUInt64(this->sensors[sensorIndex].address, 1); // [1:8]
-    writeData.Data[9] = DS18B20::Command::ReadScratchpad;        // [9]
+    writeData.Data[0] = W1::RomCommand::MatchRom;          // [0]
+    writeData.FromUInt64(this->addresses[sensorIndex], 1); // [1:8]
+    for (uint8_t i = 0; i < family.readCommandLength; i++)
+    {
+        writeData.Data[9 + i] = family.readCommand[i];     // [9:]
+    }
 
-    for (uint8_t i = 0; i < 10; i++)
+    uint8_t readOffset = this->GetReadOffset(sensorIndex);
+    for (uint8_t i = 0; i < readOffset; i++)
     {
         writeMask.Data[i] = 0xFF;
     }
 
-    // write 80 bits (2 bytes command, 8 bytes address)
-    // read 16 bits (temperature)
-    this->oneWireBus.ReadWrite(true, writeData, writeMask, 96);
+    // write MatchRom, address and read command, read first 'length' bytes of scratchpad
+    this->oneWireBus.ReadWrite(true, writeData, writeMask, (readOffset + length) * 8);
+}
+
+// Match ROM followed by command (write only)
+void DS18B20::Driver::SendCommand(uint8_t sensorIndex, const uint8_t *command, uint8_t length)
+{
+    W1::BitBlock writeData;
+    W1::BitBlock writeMask;
+    writeData.Data[0] = W1::RomCommand::MatchRom;          // [0]
+    writeData.FromUInt64(this->addresses[sensorIndex], 1); // [1:8]
+    for (uint8_t i = 0; i < length; i++)
+    {
+        writeData.Data[9 + i] = command[i];                // [9:]
+    }
+
+    for (uint8_t i = 0; i < 9 + length; i++)
+    {
+        writeMask.Data[i] = 0xFF;
+    }
+    this->oneWireBus.ReadWrite(true, writeData, writeMask, (9 + length) * 8);
+}
+
+uint8_t DS18B20::Driver::GetConfigurationRegister(uint8_t sensorIndex)
+{
+    return (static_cast<uint8_t>(this->resolutions[sensorIndex]) << 5) | 0x1F;
+}
+
+// Checks CRC of whole scratchpad received by ReadScratchpad (accumulated by the bus during reception, read bits = scratchpad).
+// Missing device returns all ones which doesn't pass the CRC. Line stuck low (no presence pulse after the reset) reads
+// all zeros which passes the CRC, it is rejected before.
+bool DS18B20::Driver::IsScratchpadValid(uint8_t sensorIndex)
+{
+    uint8_t lane = this->lanes[sensorIndex];
+    if (!this->oneWireBus.IsSlavePresent(lane))
+        return false;
+
+    const uint8_t * data = this->GetScratchpad(sensorIndex);
+    uint8_t ones = 0;
+    for (uint8_t i = 0; i < this->GetFamily(sensorIndex).readLength; i++)
+    {
+        ones |= data[i];
+    }
+    return ones != 0 && this->oneWireBus.GetReceivedCrc(lane) == 0;
+}
+
+// Single sensor read is written to all lanes, only the lane with the sensor returns valid scratchpad
+// (lane of cached ROM codes is not known), returns lane count if no lane responds
+uint8_t DS18B20::Driver::FindRespondingLane()
+{
+    uint8_t lane = 0;
+    while (lane < this->oneWireBus.GetLaneCount() &&
+           !(this->oneWireBus.IsSlavePresent(lane) && this->oneWireBus.GetReceivedCrc(lane) == 0))
+        lane++;
+    return lane;
+}
+
+// Repeats the last scratchpad read (CRC error), returns false if there is no retry left
+bool DS18B20::Driver::RetryRead(uint8_t length)
+{
+    if (this->readRetryCount >= C_ReadRetryCount)
+        return false;
+
+    this->readRetryCount++;
+    this->ReadScratchpad(this->currentSensorIndex, length);
+    return true;
+}
+
+// Checks scratchpad received by ReadScratchpad. Returns false if configuration has to be written.
+// TH and TL (stored to EEPROM)
+bool DS18B20::Driver::IsConfigurationUpToDate(uint8_t sensorIndex)
+{
+    uint8_t configurationLength = this->GetFamily(sensorIndex).configurationLength;
+    const uint8_t * scratchpad = this->GetScratchpad(sensorIndex);
+    return configurationLength < 2 || (scratchpad[DS18B20::Scratchpad::AlarmHigh] == static_cast<uint8_t>(this->alarmHigh[sensorIndex]) &&
+                                       scratchpad[DS18B20::Scratchpad::AlarmLow] == static_cast<uint8_t>(this->alarmLow[sensorIndex]));
+}
+
+// Configuration register (scratchpad only, EEPROM value is restored at power-on and rewritten by the check)
+bool DS18B20::Driver::IsResolutionUpToDate(uint8_t sensorIndex)
+{
+    const uint8_t * scratchpad = this->GetScratchpad(sensorIndex);
+    return this->GetFamily(sensorIndex).configurationLength < 3 ||
+           scratchpad[DS18B20::Scratchpad::Configuration] == this->GetConfigurationRegister(sensorIndex);
+}
+
+uint8_t DS18B20::Driver::FindPendingConfiguration(uint8_t firstSensorIndex)
+{
+    uint8_t i = firstSensorIndex;
+    while (i < this->sensorsCount && !this->isConfigurationPending.IsSet(i))
+        i++;
+    return i;
+}
+
+uint8_t DS18B20::Driver::FindPendingResolution(uint8_t firstSensorIndex)
+{
+    uint8_t i = firstSensorIndex;
+    while (i < this->sensorsCount && !this->isResolutionPending.IsSet(i))
+        i++;
+    return i;
+}
+
+// Sensors with scratchpad (ID only devices are skipped)
+uint8_t DS18B20::Driver::FindNextCheck(uint8_t firstSensorIndex)
+{
+    uint8_t i = firstSensorIndex;
+    while (i < this->sensorsCount && this->GetFamily(i).readCommandLength == 0)
+        i++;
+    return i;
+}
+
+// In AlarmingSensors mode only sensors found by Alarm Search (or not supporting it) are read
+uint8_t DS18B20::Driver::FindNextReadout(uint8_t firstSensorIndex)
+{
+    uint8_t i = this->FindNextCheck(firstSensorIndex);
+    while (i < this->sensorsCount && this->readoutMode == DS18B20::ReadoutMode::AlarmingSensors &&
+           this->GetFamily(i).isAlarmSearchSupported && !this->isAlarm.IsSet(i))
+    {
+        i = this->FindNextCheck(i + 1);
+    }
+    return i;
+}
+
+uint8_t DS18B20::Driver::FindNextLaneReadout(uint8_t lane, uint8_t firstSensorIndex)
+{
+    uint8_t i = this->FindNextReadout(firstSensorIndex);
+    while (i < this->sensorsCount && this->lanes[i] != lane)
+        i = this->FindNextReadout(i + 1);
+    return i;
+}
+
+// Search ROM (Alarm Search in AlarmSearch state, paused after each device in Rescan state) of one lane of the bus
+void DS18B20::Driver::StartSearch(uint8_t lane)
+{
+    if (lane == 0)
+    {
+        this->isSearchComplete = true;
+    }
+    this->searchLane = lane;
+    this->searchRomHelper.Run(this->state == DS18B20::DriverState::Rescan ? C_RescanPauseUs : 0,
+                              this->state == DS18B20::DriverState::AlarmSearch ? W1::RomCommand::AlarmSearch : W1::RomCommand::SearchRom,
+                              lane);
+}
+
+// Continues with the next lane of multi-lane bus, returns false if all lanes are searched
+bool DS18B20::Driver::ContinueSearch()
+{
+    this->isSearchComplete = this->isSearchComplete && this->searchRomHelper.IsSearchComplete();
+    if (this->searchLane + 1 >= this->oneWireBus.GetLaneCount())
+        return false;
+
+    this->StartSearch(this->searchLane + 1);
+    return true;
+}
+
+void DS18B20::Driver::StartReadout()
+{
+    if (this->readoutMode == DS18B20::ReadoutMode::AlarmingSensors)
+    {
+        this->state = DS18B20::DriverState::AlarmSearch;
+        this->isAlarm.SetAll(false);
+        this->StartSearch();
+    }
+    else
+    {
+        this->StartResultsRead();
+    }
+}
+
+// Measurement cycle is done, continue with background search (if it's time) or go to idle
+void DS18B20::Driver::CompleteConversion()
+{
+    this->PublishSnapshot();
+    this->isConversionCompleted = true;
+    if (!this->StartRescanIfDue())
+    {
+        this->EnterIdleState();
+    }
+}
+
+// Detects parasite powered sensors (Read Power Supply, any parasite powered sensor pulls the read slot low),
+// then reads scratchpad of all sensors to check their presence and configuration
+void DS18B20::Driver::StartSensorsCheck()
+{
+    this->state = DS18B20::DriverState::ReadPowerSupply;
+    this->oneWireBus.ReadWrite(true, (DS18B20::Command::ReadPowerSupply << 8) | W1::RomCommand::SkipRom, 0xFFFF, 17);
+}
+
+void DS18B20::Driver::ContinueSensorsCheck()
+{
+    this->currentSensorIndex = this->FindNextCheck(0);
+    if (this->currentSensorIndex < this->sensorsCount)
+    {
+        this->state = DS18B20::DriverState::ReadConfiguration;
+        this->ReadScratchpad(this->currentSensorIndex, this->GetFamily(this->currentSensorIndex).readLength);
+    }
+    else
+    {
+        this->isSensorListFromCache = false;
+        this->EnterIdleState();
+    }
+}
+
+void DS18B20::Driver::LoadCachedRomCodes()
+{
+    this->sensorsCount = this->romCodeCache ? this->romCodeCache->Load(this->addresses, W1::SearchRomHelper::C_maxDeviceCount) : 0;
+    for (uint8_t i = 0; i < this->sensorsCount; i++)
+    {
+        this->lanes[i] = 0; // found by sensors check
+        this->InitSensor(i, this->addresses[i]);
+    }
+    this->isSensorListFromCache = this->sensorsCount > 0;
+}
+
+void DS18B20::Driver::StoreRomCodes()
+{
+    if (this->romCodeCache)
+    {
+        this->romCodeCache->Store(this->addresses, this->sensorsCount);
+    }
+}
+
+// Writes TH, TL (and configuration register if the family has it)
+void DS18B20::Driver::WriteConfiguration(uint8_t sensorIndex)
+{
+    uint8_t command[4];
+    command[0] = DS18B20::Command::WriteScratchpad;
+    command[1] = this->alarmHigh[sensorIndex];     // TH
+    command[2] = this->alarmLow[sensorIndex];      // TL
+    command[3] = this->GetConfigurationRegister(sensorIndex);
+    this->SendCommand(sensorIndex, command, 1 + this->GetFamily(sensorIndex).configurationLength);
+}
+
+void DS18B20::Driver::CopyScratchpad(uint8_t sensorIndex)
+{
+    uint8_t command = DS18B20::Command::CopyScratchpad;
+    if (this->isParasitePowered)
+    {
+        // EEPROM write current is supplied through the data line, strong pull-up is released after C_EepromOverlapUs
+        this->oneWireBus.RequestStrongPullUp();
+    }
+    this->SendCommand(sensorIndex, &command, 1);
 }
 
 TS::DoWorkResult DS18B20::Driver::DoWork(TS::TimeslotInfo &timeslotInfo)
@@ -104,41 +1047,80 @@ TS::DoWorkResult DS18B20::Driver::DoWorkInternal(TS::TimeslotInfo &timeslotInfo)
     while (true)
     {
         TS::DoWorkResult doWorkRes;
-        if (this->state == DS18B20::DriverState::SearchRom)
+        if (this->state == DS18B20::DriverState::Rescan)
         {
             doWorkRes = this->searchRomHelper.DoWork(timeslotInfo);
             if (doWorkRes.type == TS::DoWorkResultType::Completed)
             {
-                // search ROM comlpeted, store addresses
-                this->sensorsCount = this->searchRomHelper.GetDeviceCount();
-                for (uint8_t i = 0; i < this->sensorsCount; i++)
+                if (this->ContinueSearch())
+                    continue;
+
+                // missing sensors are removed only if the search was not aborted
+                bool isChanged = this->isSensorAdded;
+                if (this->isSearchComplete)
+                {
+                    isChanged |= this->RemoveMissingSensors();
+                }
+                if (isChanged)
                 {
-                    this->sensors[i].address = this->searchRomHelper.GetDeviceAddress(i);
-                    this->sensors[i].dataValid = false;
+                    this->StoreRomCodes();
                 }
 
-                // write configuration if enabled
+                // new sensors may need configuration
+                if (this->isSensorAdded && C_DoSensorInitialization)
+                {
+                    this->StartSensorsCheck();
+                }
+                else
+                {
+                    this->EnterIdleState();
+                }
+            }
+            else
+            {
+                return doWorkRes;
+            }
+        }
+        else if (this->state == DS18B20::DriverState::AlarmSearch)
+        {
+            doWorkRes = this->searchRomHelper.DoWork(timeslotInfo);
+            if (doWorkRes.type == TS::DoWorkResultType::Completed)
+            {
+                if (this->ContinueSearch())
+                    continue;
+
+                // alarm flags were set by OnDeviceFound, if the search failed, all sensors are read
+                if (!this->isSearchComplete)
+                {
+                    this->isAlarm.SetAll(true);
+                }
+
+                this->StartResultsRead();
+            }
+            else
+            {
+                return doWorkRes;
+            }
+        }
+        else if (this->state == DS18B20::DriverState::SearchRom)
+        {
+            doWorkRes = this->searchRomHelper.DoWork(timeslotInfo);
+            if (doWorkRes.type == TS::DoWorkResultType::Completed)
+            {
+                if (this->ContinueSearch())
+                    continue;
+
+                // search ROM comlpeted, addresses were stored by OnDeviceFound
+                this->StoreRomCodes();
+
+                // check configuration of sensors (write it only if some sensor differs) if enabled
                 if (this->sensorsCount && C_DoSensorInitialization)
                 {
-                    uint8_t configReg = (static_cast<uint8_t>(C_SensorResolution) << 5) | 0x1F;
-                    this->state = DS18B20::DriverState::WriteScratchpad;
-                    W1::BitBlock writeData;
-                    W1::BitBlock writeMask;
-                    writeData.Data[0] = W1::RomCommand::SkipRom; //write all DS18B20 sensors
-                    writeMask.Data[0] = 0xFF;
-                    writeData.Data[1] = DS18B20::Command::WriteScratchpad;
-                    writeMask.Data[1] = 0xFF;
-                    writeData.Data[2] = 0x00;
-                    writeMask.Data[2] = 0xFF;
-                    writeData.Data[3] = 0x00;
-                    writeMask.Data[3] = 0xFF;
-                    writeData.Data[4] = configReg;
-                    writeMask.Data[4] = 0xFF;
-                    this->oneWireBus.ReadWrite(true, writeData, writeMask, 40);
+                    this->StartSensorsCheck();
                 }
                 else
                 {
-                    this->state = DS18B20::DriverState::Idle;
+                    this->EnterIdleState();
                 }
             }
             else
@@ -153,24 +1135,103 @@ TS::DoWorkResult DS18B20::Driver::DoWorkInternal(TS::TimeslotInfo &timeslotInfo)
             {
                 if (this->state == DS18B20::DriverState::Init)
                 {
-                    this->searchRomHelper.Run();
-                    this->state = DS18B20::DriverState::SearchRom;
+                    this->state = DS18B20::DriverState::Calibration;
+                    this->oneWireBus.Calibrate();
+                }
+                else if (this->state == DS18B20::DriverState::Calibration)
+                {
+                    this->LoadCachedRomCodes();
+                    if (this->isSensorListFromCache)
+                    {
+                        // verify cached addresses instead of searching the bus
+                        this->StartSensorsCheck();
+                    }
+                    else
+                    {
+                        this->state = DS18B20::DriverState::SearchRom;
+                        this->StartSearch();
+                    }
                 }
                 else if (this->state == DS18B20::DriverState::SearchRom)
                 {
                     // this state is handled in the branch above
                     ASSERT(false);
                 }
+                else if (this->state == DS18B20::DriverState::ReadPowerSupply)
+                {
+                    this->isParasitePowered = false;
+                    for (uint8_t lane = 0; lane < this->oneWireBus.GetLaneCount(); lane++)
+                    {
+                        this->isParasitePowered |= this->oneWireBus.IsSlavePresent(lane) && this->oneWireBus.GetReceivedData(lane).IsZero(16);
+                    }
+                    this->ContinueSensorsCheck();
+                }
+                else if (this->state == DS18B20::DriverState::ReadConfiguration)
+                {
+                    uint8_t readLength = this->GetFamily(this->currentSensorIndex).readLength;
+                    uint8_t lane = this->FindRespondingLane();
+                    bool isValid = lane < this->oneWireBus.GetLaneCount();
+                    if (!isValid && this->RetryRead(readLength))
+                    {
+                        continue;
+                    }
+                    this->readRetryCount = 0;
+                    if (isValid)
+                    {
+                        this->lanes[this->currentSensorIndex] = lane;
+                    }
+
+                    if (!isValid && this->isSensorListFromCache)
+                    {
+                        // cached sensor doesn't respond, the cache is stale => search the bus
+                        this->isSensorListFromCache = false;
+                        this->sensorsCount = 0;
+                        this->state = DS18B20::DriverState::SearchRom;
+                        this->StartSearch();
+                        continue;
+                    }
+
+                    bool hasConfiguration = this->GetFamily(this->currentSensorIndex).configurationLength > 0;
+                    if (isValid && hasConfiguration && !this->isConfigurationPending.IsSet(this->currentSensorIndex))
+                    {
+                        // thresholds were not changed by application => keep values stored in the sensor
+                        const uint8_t * scratchpad = this->GetScratchpad(this->currentSensorIndex);
+                        this->alarmHigh[this->currentSensorIndex] = scratchpad[DS18B20::Scratchpad::AlarmHigh];
+                        this->alarmLow[this->currentSensorIndex] = scratchpad[DS18B20::Scratchpad::AlarmLow];
+                    }
+                    this->isConfigurationPending.Set(this->currentSensorIndex, hasConfiguration && (!isValid || !this->IsConfigurationUpToDate(this->currentSensorIndex)));
+                    if (isValid && !this->isResolutionWritten && this->GetFamily(this->currentSensorIndex).configurationLength >= 3)
+                    {
+                        // scratchpad holds the EEPROM value until the driver writes the register
+                        const uint8_t * scratchpad = this->GetScratchpad(this->currentSensorIndex);
+                        this->eepromResolutions[this->currentSensorIndex] = static_cast<DS18B20::SensorResolution>((scratchpad[DS18B20::Scratchpad::Configuration] >> 5) & 0x03);
+                    }
+                    this->isResolutionPending.Set(this->currentSensorIndex, isValid && !this->IsResolutionUpToDate(this->currentSensorIndex));
+                    this->isResolutionUnconfirmed.Set(this->currentSensorIndex, !isValid);
+
+                    if ((this->currentSensorIndex = this->FindNextCheck(this->currentSensorIndex + 1)) < this->sensorsCount)
+                    {
+                        this->ReadScratchpad(this->currentSensorIndex, this->GetFamily(this->currentSensorIndex).readLength);
+                        continue;
+                    }
+
+                    // cache is verified, failures of later checks (thresholds changed, sensor added) must not restart the search
+                    this->isSensorListFromCache = false;
+                    if ((this->currentSensorIndex = this->FindPendingConfiguration(0)) < this->sensorsCount && C_DoSensorInitialization)
+                    {
+                        this->state = DS18B20::DriverState::WriteScratchpad;
+                        this->WriteConfiguration(this->currentSensorIndex);
+                    }
+                    else
+                    {
+                        // all sensors are already configured, skip EEPROM write
+                        this->EnterIdleState();
+                    }
+                }
                 else if (this->state == DS18B20::DriverState::WriteScratchpad)
                 {
                     this->state = DS18B20::DriverState::WriteToEeprom;
-                    W1::BitBlock writeData;
-                    W1::BitBlock writeMask;
-                    writeData.Data[0] = W1::RomCommand::SkipRom;
-                    writeMask.Data[0] = 0xFF;
-                    writeData.Data[1] = DS18B20::Command::CopyScratchpad;
-                    writeMask.Data[1] = 0xFF;
-                    this->oneWireBus.ReadWrite(true, writeData, writeMask, 16);
+                    this->CopyScratchpad(this->currentSensorIndex);
                 }
                 else if (this->state == DS18B20::DriverState::WriteToEeprom)
                 {
@@ -179,7 +1240,38 @@ TS::DoWorkResult DS18B20::Driver::DoWorkInternal(TS::TimeslotInfo &timeslotInfo)
                 }
                 else if (this->state == DS18B20::DriverState::EepromOverlap)
                 {
-                    this->state = DS18B20::DriverState::Idle;
+                    this->oneWireBus.EndStrongPullUp();
+                    this->isConfigurationPending.Set(this->currentSensorIndex, false);
+                    this->isResolutionPending.Set(this->currentSensorIndex, false); // written together with TH, TL
+                    this->eepromResolutions[this->currentSensorIndex] = this->resolutions[this->currentSensorIndex];
+                    this->currentSensorIndex = this->FindPendingConfiguration(this->currentSensorIndex + 1);
+                    if (this->currentSensorIndex < this->sensorsCount)
+                    {
+                        this->state = DS18B20::DriverState::WriteScratchpad;
+                        this->WriteConfiguration(this->currentSensorIndex);
+                    }
+                    else
+                    {
+                        this->EnterIdleState();
+                    }
+                }
+                else if (this->state == DS18B20::DriverState::WriteResolution)
+                {
+                    // missing sensor keeps the write pending (repeated before next conversion), readout compares the rest
+                    if (this->oneWireBus.IsSlavePresent(this->lanes[this->currentSensorIndex]))
+                    {
+                        this->isResolutionPending.Set(this->currentSensorIndex, false);
+                    }
+                    this->isResolutionWritten = true;
+                    this->currentSensorIndex = this->FindPendingResolution(this->currentSensorIndex + 1);
+                    if (this->currentSensorIndex < this->sensorsCount)
+                    {
+                        this->WriteConfiguration(this->currentSensorIndex);
+                    }
+                    else
+                    {
+                        this->state = DS18B20::DriverState::BeforeConversion;
+                    }
                 }
                 else if (this->state == DS18B20::DriverState::Idle)
                 {
@@ -187,58 +1279,108 @@ TS::DoWorkResult DS18B20::Driver::DoWorkInternal(TS::TimeslotInfo &timeslotInfo)
                 }
                 else if (this->state == DS18B20::DriverState::BeforeConversion)
                 {
-                    if (this->sensorsCount > 0)
+                    if (this->isConfigurationRequested && this->sensorsCount > 0)
+                    {
+                        // write new alarm thresholds first, the conversion continues afterwards
+                        this->isConfigurationRequested = false;
+                        this->isConversionRequested = true;
+                        this->StartSensorsCheck();
+                    }
+                    else if ((this->currentSensorIndex = this->FindPendingResolution(0)) < this->sensorsCount)
                     {
+                        this->state = DS18B20::DriverState::WriteResolution;
+                        this->WriteConfiguration(this->currentSensorIndex);
+                    }
+                    else if ((this->conversionTimeUs = this->GetConversionTimeUs()) > 0)
+                    {
+                        // all families in the registry share Convert T => one broadcast starts conversion in all sensors
                         this->state = DS18B20::DriverState::StartConversion;
+                        this->isReconverted.SetAll(false);
+                        this->cycleStartTime = MonotonicClock::Now();
                         W1::BitBlock writeData;
                         W1::BitBlock writeMask;
                         writeData.Data[0] = W1::RomCommand::SkipRom;
                         writeMask.Data[0] = 0xFF;
                         writeData.Data[1] = DS18B20::Command::Convert;
                         writeMask.Data[1] = 0xFF;
+                        if (this->isParasitePowered)
+                        {
+                            // conversion current is supplied through the data line for the whole conversion time
+                            this->oneWireBus.RequestStrongPullUp();
+                        }
                         this->oneWireBus.ReadWrite(true, writeData, writeMask, 16);
                     }
                     else
                     {
-                        //no sensors, nothing to do
-                        this->state = DS18B20::DriverState::Idle;
-                        this->isConversionCompleted = true;
-                        return timeslotInfo.Completed();
+                        //no sensors (or nothing to convert), nothing to do
+                        this->CompleteConversion();
                     }
                 }
                 else if (this->state == DS18B20::DriverState::StartConversion)
                 {
+                    if (C_PollConversionDone && !this->isParasitePowered)
+                    {
+                        // wait for typical conversion time, then poll sensors until all of them report done
+                        this->state = DS18B20::DriverState::PollConversion;
+                        this->conversionWaitUs = this->GetMinConversionTimeUs();
+                        return timeslotInfo.WaitForLongTime(this->conversionWaitUs, C_TimeslotLengthUs);
+                    }
                     this->state = DS18B20::DriverState::Conversion;
-                    this->currentSensorIndex = 0;
-                    return timeslotInfo.WaitForLongTime(this->GetConversionTimeUs(), C_TimeslotLengthUs); // wait until sensor completes conversion
+                    return timeslotInfo.WaitForLongTime(this->conversionTimeUs, C_TimeslotLengthUs); // wait until sensor completes conversion
                 }
                 else if (this->state == DS18B20::DriverState::Conversion)
                 {
-                    this->state = DS18B20::DriverState::ReadResult;
-                    this->ReadResult(this->currentSensorIndex);
+                    this->oneWireBus.EndStrongPullUp();
+                    this->StartReadout();
+                }
+                else if (this->state == DS18B20::DriverState::PollConversion)
+                {
+                    // sensors keep the bus low during read slot while conversion is in progress (wired AND => 1 = all sensors done)
+                    this->state = DS18B20::DriverState::PollConversionRead;
+                    this->oneWireBus.Read(false, 1);
+                }
+                else if (this->state == DS18B20::DriverState::PollConversionRead)
+                {
+                    bool conversionDone = true;
+                    for (uint8_t lane = 0; lane < this->oneWireBus.GetLaneCount(); lane++)
+                    {
+                        conversionDone = conversionDone && this->oneWireBus.GetReceivedData(lane).IsOne(0);
+                    }
+                    if (conversionDone || this->conversionWaitUs >= this->conversionTimeUs)
+                    {
+                        this->StartReadout();
+                    }
+                    else
+                    {
+                        this->state = DS18B20::DriverState::PollConversion;
+                        this->conversionWaitUs += C_ConversionPollPeriodUs;
+                        return timeslotInfo.WaitForLongTime(C_ConversionPollPeriodUs, C_TimeslotLengthUs);
+                    }
                 }
                 else if (this->state == DS18B20::DriverState::ReadResult)
                 {
-                    W1::BitBlock receivedData = this->oneWireBus.GetReceivedData();
-                    uint8_t hByte = receivedData.Data[this->oneWireBus.GetReadWriteLength() / 8 - 1];
-                    uint8_t lByte = receivedData.Data[this->oneWireBus.GetReadWriteLength() / 8 - 2];
-                    this->sensors[this->currentSensorIndex].dataValid = true;
-                    int16_t temperature16Bits = ((hByte << 8) | lByte);
-                    int32_t temperature = temperature16Bits * 10000 / 16;
-                    this->sensors[this->currentSensorIndex].temperature = temperature;
-
-                    this->currentSensorIndex++;
-                    if (this->currentSensorIndex < this->sensorsCount)
+                    // all queued reads are done (results stored by OnTransactionCompleted)
+                    if ((this->currentSensorIndex = this->FindPendingReconversion(0)) < this->sensorsCount)
                     {
-                        this->ReadResult(this->currentSensorIndex);
+                        this->StartReconversion(this->currentSensorIndex);
                     }
                     else
                     {
-                        this->state = DS18B20::DriverState::Idle;
-                        this->isConversionCompleted = true;
-                        return timeslotInfo.Completed();
+                        this->CompleteConversion();
                     }
                 }
+                else if (this->state == DS18B20::DriverState::Reconversion)
+                {
+                    this->state = DS18B20::DriverState::ReconversionWait;
+                    return timeslotInfo.WaitForLongTime(this->GetConversionTimeUs(this->currentSensorIndex), C_TimeslotLengthUs);
+                }
+                else if (this->state == DS18B20::DriverState::ReconversionWait)
+                {
+                    this->oneWireBus.EndStrongPullUp();
+                    this->state = DS18B20::DriverState::ReadResult;
+                    this->EnqueueResultRead(this->currentSensorIndex, 0);
+                    this->currentSensorIndex = this->sensorsCount; // nothing else to enqueue
+                }
                 else
                 {
                     // unknown state
@@ -4,21 +4,37 @@
 #include "TimeslotManager.h"
 #include "OneWire.h"
 #include "SupplyBranch.h"
+#include "RomCodeCache.h"
+#include "CalibrationTable.h"
+#include "BitSet.h"
+#include "SeqLock.h"
+#include "MonotonicClock.h"
+#include "DeviceFamily.h"
 
 namespace DS18B20
 {
     enum class DriverState
     {
         Init,
+        Calibration, // bus timing is adapted to the measured rise time
         SearchRom,
+        ReadPowerSupply, // detection of parasite powered sensors
+        ReadConfiguration,
         WriteScratchpad,
         WriteToEeprom,
+        WriteResolution, // scratchpad only (resolution changed at runtime is not stored to EEPROM)
         EepromOverlap, // time overlap
         Idle,
+        Rescan, // background search for added/removed sensors
         BeforeConversion,
         StartConversion,
         Conversion,
-        ReadResult
+        PollConversion, // waiting between conversion-done polls
+        PollConversionRead,
+        AlarmSearch,
+        ReadResult, // sensors are read by queued bus transactions
+        Reconversion, // single sensor returned power-on value, conversion is repeated
+        ReconversionWait
     };
 
     class Command
@@ -32,14 +48,54 @@ namespace DS18B20
         static const uint8_t ReadPowerSupply = 0xB4;
     };
 
+    class Scratchpad
+    {
+    public:
+        static const uint8_t TemperatureLsb = 0;
+        static const uint8_t TemperatureMsb = 1;
+        static const uint8_t AlarmHigh = 2; // TH
+        static const uint8_t AlarmLow = 3;  // TL
+        static const uint8_t Configuration = 4;
+        static const uint8_t Crc = 8;
+        static const uint8_t Length = 9;
+    };
+
     struct TemperatureInfo
     {
         uint64_t address;
-        int32_t temperature;
+        uint32_t timestamp;     // MonotonicClock time of the last valid read (age of values with dataValid = false)
+        int16_t rawTemperature; // 1/256 °C (calibrated)
         bool dataValid;
+        bool isAlarm; // temperature >= TH or temperature <= TL (integer part of temperature is compared)
+    };
+
+    struct SensorErrorCounters
+    {
+        uint16_t crcErrors;     // scratchpad read with CRC error (each attempt)
+        uint16_t missing;       // no presence pulse or all ones read
+        uint16_t powerOnValues; // 85 °C power-on value read (conversion did not run, e.g. supply dropout)
+    };
+
+    // Consistent result set of one measurement cycle (same layout as the driver tables, held only by the driver)
+    struct MeasurementSnapshot
+    {
+        uint32_t cycle; // number of completed measurements, 0 = no measurement yet
+        uint32_t cycleStartTime; // MonotonicClock time of conversion start
+        uint8_t sensorsCount;
+        uint64_t addresses[W1::SearchRomHelper::C_maxDeviceCount];
+        uint32_t timestamps[W1::SearchRomHelper::C_maxDeviceCount];
+        int16_t temperatures[W1::SearchRomHelper::C_maxDeviceCount]; // 1/256 °C (calibrated)
+        BitSet<W1::SearchRomHelper::C_maxDeviceCount> isDataValid;
+        BitSet<W1::SearchRomHelper::C_maxDeviceCount> isAlarm;
+    };
+
+    enum class ReadoutMode
+    {
+        AllSensors,     // read scratchpad of all sensors after each conversion
+        AlarmingSensors // run Alarm Search after conversion and read only sensors in alarm state (others keep last value)
     };
 
-    enum class SensorResolution
+    enum class SensorResolution : uint8_t
     {
         Bits9  = 0,  // [+-] 0.5    °C
         Bits10 = 1,  // [+-] 0.25   °C
@@ -47,41 +103,168 @@ namespace DS18B20
         Bits12 = 3   // [+-] 0.0625 °C 
     };
 
-    class Driver : public TS::ITimeslotTask
+    enum class ResolutionPolicy
+    {
+        Fixed,   // resolution set by SetResolution (C_SensorResolution by default)
+        Adaptive // 9 bits while temperature is stable, 12 bits while it is changing or near alarm thresholds
+    };
+
+    // Temperature sensors driver, device specific commands and decoding are taken from W1::DeviceFamilyRegistry
+    // (DS18B20, DS1822, DS18S20, DS2438, ID only devices are kept in the sensor list without readout).
+    class Driver : public TS::ITimeslotTask, public W1::ISearchRomListener, public W1::IOneWireTransactionListener
     {
         public:            
             static const bool C_DoSensorInitialization = true;
-            static const SensorResolution C_SensorResolution = SensorResolution::Bits11;
+            static const SensorResolution C_SensorResolution = SensorResolution::Bits11; // initial resolution of each sensor
+            static const int16_t C_StableDelta = 128; // [1/256 °C] adaptive resolution: larger change between cycles = changing temperature
+            static const uint8_t C_StableCycles = 10; // adaptive resolution: stable cycles before resolution drops to 9 bits
+            static const int8_t C_AlarmMargin = 2;    // [°C] adaptive resolution: 12 bits within margin of TH/TL
             static const uint32_t C_EepromOverlapUs = 10000;
             static const uint32_t C_DelayAfterPowerOn = 10000;
             static const uint32_t C_TimeslotLengthUs = 2000;
+            static const bool C_PollConversionDone = true; // used only if all sensors are externally powered (parasite powered sensors cannot answer read slots)
+            static const uint32_t C_ConversionPollPeriodUs = 10000;
+            static const uint8_t C_RescanIntervalCycles = 6; // background search every N measurements, 0 = disabled
+            static const uint32_t C_RescanPauseUs = 20000; // pause between found devices during background search (keeps timeslots short)
+            static const int8_t C_DefaultAlarmHigh = 0; // TH written to sensors without valid scratchpad, TH = TL = 0 => sensor is always in alarm state
+            static const int8_t C_DefaultAlarmLow = 0;
+            static const uint8_t C_ReadRetryCount = 2; // immediate repetitions of scratchpad read with CRC error
+            static const uint16_t C_RecallTag = 0x8000; // transaction tag: [7:0] sensor index, [13:8] retry count, [14] lockstep, [15] recall
+            static const uint16_t C_LockstepTag = 0x4000; // multi-lane bus, [7:0] = lockstep slot (sensors read by the transaction)
+            static const uint8_t C_LockstepSlotCount = W1::OneWireBus::C_QueueLength + 1; // queued transactions and the running one
+            static const uint8_t C_NoSensor = 0xFF;
 
-            Driver(TS::TimeslotManager & timeslotManager, W1::OneWireBus & bus, SupplyBranchHandle supplyBranch);
+            Driver(TS::TimeslotManager & timeslotManager, W1::OneWireBus & bus, SupplyBranchHandle supplyBranch, W1::RomCodeCache * romCodeCache = nullptr,
+                   DS18B20::CalibrationTable * calibrationTable = nullptr);
             bool IsReady();
-            const TemperatureInfo * GetResult();
+            TemperatureInfo GetResult(uint8_t sensorIndex); // live value (may be updated by timeslot while reading), use snapshot from main loop
+            // results of the last completed measurement (never mixed with a running one), read sensor by sensor without a copy
+            // of the whole snapshot: GetSnapshotResult returns false when a newer snapshot replaced the given cycle
+            uint32_t GetSnapshotCycle(uint8_t & sensorsCount, uint32_t & cycleStartTime);
+            bool GetSnapshotResult(uint32_t cycle, uint8_t sensorIndex, TemperatureInfo & info);
             uint8_t GetSensorsCount();
             void StartConversion();
             bool IsConversionCompleted();
+            void SetAlarmThresholds(uint8_t sensorIndex, int8_t alarmLow, int8_t alarmHigh);
+            void SetReadoutMode(ReadoutMode mode);
+            // resolution is written to scratchpad before the next conversion (families with configuration register only)
+            void SetResolution(uint8_t sensorIndex, SensorResolution resolution);
+            SensorResolution GetResolution(uint8_t sensorIndex);
+            void SetResolutionPolicy(ResolutionPolicy policy);
+            SensorErrorCounters GetErrorCounters(uint8_t sensorIndex);
+            bool IsParasitePowered(); // some sensor is parasite powered => strong pull-up is used during Convert T and Copy Scratchpad
 
             virtual TS::DoWorkResult DoWork(TS::TimeslotInfo &timeslotInfo) override;
             virtual void Init() override;
             virtual uint32_t GetRequestedDuration() override;
+            virtual void OnDeviceFound(uint64_t address) override;
+            virtual void OnTransactionCompleted(uint16_t tag) override;
             TS::DoWorkResult DoWorkInternal(TS::TimeslotInfo &timeslotInfo);
 
         private:
             uint32_t GetConversionTimeUs();
-            void ReadResult(uint8_t sensorIndex);
+            uint32_t GetConversionTimeUs(uint8_t sensorIndex);
+            uint32_t GetMinConversionTimeUs();
+            const W1::DeviceFamily & GetFamily(uint8_t sensorIndex);
+            uint8_t GetReadOffset(uint8_t sensorIndex);
+            const uint8_t * GetScratchpad(uint8_t sensorIndex); // received data of the sensor's lane from read offset
+            void StartResultsRead();
+            void EnqueueResultsRead();
+            void EnqueueResultRead(uint8_t sensorIndex, uint8_t retryCount);
+            void EnqueueLockstepReads();
+            void EnqueueLockstepRead(uint8_t slot, uint8_t retryCount);
+            void OnLockstepReadCompleted(uint8_t slot, uint8_t retryCount);
+            uint8_t FindFreeLockstepSlot();
+            bool IsLockstepCompatible(uint8_t referenceIndex, uint8_t sensorIndex);
+            void CountReadError(uint8_t sensorIndex);
+            void PrepareTransaction(W1::OneWireTransaction & transaction, uint8_t sensorIndex, const uint8_t * command, uint8_t length);
+            void StoreResult(uint8_t sensorIndex, bool isValid);
+            bool IsSentinelValue(uint8_t sensorIndex, const uint8_t * data);
+            uint8_t FindPendingReconversion(uint8_t firstSensorIndex);
+            void StartReconversion(uint8_t sensorIndex);
+            void ReadScratchpad(uint8_t sensorIndex, uint8_t length);
+            void SendCommand(uint8_t sensorIndex, const uint8_t * command, uint8_t length);
+            bool IsScratchpadValid(uint8_t sensorIndex);
+            uint8_t FindRespondingLane();
+            bool RetryRead(uint8_t length);
+            bool IsConfigurationUpToDate(uint8_t sensorIndex);
+            bool IsResolutionUpToDate(uint8_t sensorIndex);
+            void UpdateResolution(uint8_t sensorIndex, int16_t temperature, int16_t offset, bool isPreviousValid);
+            void StartSensorsCheck();
+            void ContinueSensorsCheck();
+            void LoadCachedRomCodes();
+            void StoreRomCodes();
+            void EnterIdleState();
+            bool StartRescanIfDue();
+            bool RemoveMissingSensors();
+            void InitSensor(uint8_t sensorIndex, uint64_t address);
+            void MoveSensor(uint8_t fromIndex, uint8_t toIndex);
+            uint8_t FindSensor(uint64_t address);
+            uint8_t FindPendingConfiguration(uint8_t firstSensorIndex);
+            uint8_t FindPendingResolution(uint8_t firstSensorIndex);
+            uint8_t FindNextCheck(uint8_t firstSensorIndex);
+            uint8_t FindNextReadout(uint8_t firstSensorIndex);
+            uint8_t FindNextLaneReadout(uint8_t lane, uint8_t firstSensorIndex);
+            void StartSearch(uint8_t lane = 0);
+            bool ContinueSearch();
+            void StartReadout();
+            void CompleteConversion();
+            void PublishSnapshot();
+            void WriteConfiguration(uint8_t sensorIndex);
+            void CopyScratchpad(uint8_t sensorIndex);
+            uint8_t GetConfigurationRegister(uint8_t sensorIndex);
             bool SetSupplyBranchState();
+            void OnSensorsPoweredUp();
 
             TS::TimeslotManager & timeslotManager;
             W1::OneWireBus & oneWireBus;
-            TemperatureInfo sensors[W1::SearchRomHelper::C_maxDeviceCount];
+            // sensor tables (structure of arrays, flags packed to bits)
+            uint64_t addresses[W1::SearchRomHelper::C_maxDeviceCount];
+            uint8_t families[W1::SearchRomHelper::C_maxDeviceCount];     // index in W1::DeviceFamilyRegistry
+            uint8_t lanes[W1::SearchRomHelper::C_maxDeviceCount];        // lane of multi-lane bus the sensor is connected to
+            int16_t temperatures[W1::SearchRomHelper::C_maxDeviceCount]; // 1/256 °C
+            uint32_t timestamps[W1::SearchRomHelper::C_maxDeviceCount];  // MonotonicClock time of the last valid read
+            int8_t alarmHigh[W1::SearchRomHelper::C_maxDeviceCount];     // TH [°C]
+            int8_t alarmLow[W1::SearchRomHelper::C_maxDeviceCount];      // TL [°C]
+            SensorResolution resolutions[W1::SearchRomHelper::C_maxDeviceCount];
+            SensorResolution eepromResolutions[W1::SearchRomHelper::C_maxDeviceCount]; // loaded to the scratchpad at power-up
+            uint8_t stableCycles[W1::SearchRomHelper::C_maxDeviceCount]; // adaptive resolution: cycles without temperature change
+            SensorErrorCounters errorCounters[W1::SearchRomHelper::C_maxDeviceCount];
+            BitSet<W1::SearchRomHelper::C_maxDeviceCount> isDataValid;
+            BitSet<W1::SearchRomHelper::C_maxDeviceCount> isAlarm;
+            BitSet<W1::SearchRomHelper::C_maxDeviceCount> isConfigurationPending; // sensor configuration has to be written
+            BitSet<W1::SearchRomHelper::C_maxDeviceCount> isResolutionPending;    // configuration register has to be written (scratchpad only)
+            BitSet<W1::SearchRomHelper::C_maxDeviceCount> isResolutionUnconfirmed; // register content unknown (check failed), longest conversion time is used
+            BitSet<W1::SearchRomHelper::C_maxDeviceCount> isFound;                // sensor found by the current background search
+            BitSet<W1::SearchRomHelper::C_maxDeviceCount> isReconversionPending;  // power-on value read, conversion has to be repeated
+            BitSet<W1::SearchRomHelper::C_maxDeviceCount> isReconverted;          // conversion already repeated in this cycle
             uint8_t sensorsCount;
             uint8_t currentSensorIndex;
-            bool isConversionCompleted;
+            uint8_t readRetryCount;
+            uint32_t conversionWaitUs;
+            uint32_t conversionTimeUs; // longest conversion time of present device families
+            volatile bool isConversionCompleted;
+            bool isParasitePowered;
+            bool isResolutionWritten; // configuration register written since power-up (scratchpad may differ from EEPROM)
             DriverState state;
             W1::SearchRomHelper searchRomHelper;
+            uint8_t searchLane;     // lanes are searched one after another
+            bool isSearchComplete;  // no lane search was aborted
+            uint8_t laneReadIndex[W1::OneWirePhysicalLayer::C_MaxLanes]; // lockstep readout: next sensor of the lane
+            uint8_t lockstepSensors[C_LockstepSlotCount][W1::OneWirePhysicalLayer::C_MaxLanes]; // per lane, C_NoSensor = free
             SupplyBranchHandle supplyBranch;
+            W1::RomCodeCache * romCodeCache;
+            DS18B20::CalibrationTable * calibrationTable; // offsets applied to decoded temperatures
+            bool isSensorListFromCache;
+            bool isConversionRequested;
+            bool isConfigurationRequested; // alarm thresholds changed by application
+            bool isSensorAdded; // background search found a new sensor
+            uint8_t cyclesSinceRescan;
+            ReadoutMode readoutMode;
+            ResolutionPolicy resolutionPolicy;
+            uint32_t cycle;
+            uint32_t cycleStartTime;
+            SeqLock<MeasurementSnapshot> snapshot; // written by timeslot, read by main loop
     };
 }
 
@@ -0,0 +1,68 @@
+#include "DeviceFamily.h"
+
+extern "C"
+{
+    #include "nrf_assert.h"
+}
+
+// 1/16 °C, two's complement
+static int16_t DecodeDS18B20(const uint8_t * data)
+{
+    int16_t temperature16Bits = (data[1] << 8) | data[0];
+    return temperature16Bits * 16;
+}
+
+// 1/2 °C, extended resolution from COUNT_REMAIN (byte 6) and COUNT_PER_C (byte 7, always 16)
+static int16_t DecodeDS18S20(const uint8_t * data)
+{
+    int16_t temperatureHalfDegrees = (data[1] << 8) | data[0];
+    if (data[7] != 16)
+        return temperatureHalfDegrees * 128;
+    return (temperatureHalfDegrees >> 1) * 256 - 64 + (16 - data[6]) * 16;
+}
+
+// page 0: [1] LSB, [2] MSB, 13 bits left aligned (1/32 °C) => value is already in 1/256 °C
+static int16_t DecodeDS2438(const uint8_t * data)
+{
+    return static_cast<int16_t>(((data[2] << 8) | data[1]) & 0xFFF8);
+}
+
+// 85 °C (0x0550) with reserved byte 6 at its power-on value 0x0C, a real 85 °C reading has byte 6 = 0x10
+static bool IsPowerOnValueDS18B20(const uint8_t * data)
+{
+    return data[0] == 0x50 && data[1] == 0x05 && data[6] == 0x0C;
+}
+
+// 85 °C (0x00AA) with COUNT_REMAIN at its power-on value 0x0C
+static bool IsPowerOnValueDS18S20(const uint8_t * data)
+{
+    return data[0] == 0xAA && data[1] == 0x00 && data[6] == 0x0C;
+}
+
+// all families with conversion use Convert T (the driver sends one broadcast for all of them)
+const W1::DeviceFamily W1::DeviceFamilyRegistry::families[] =
+{
+    // family code             convert conversion  recall        read             read  config alarm  decoder        power-on value
+    { W1::FamilyCode::DS18B20, 0x44, 750000, { 0x00, 0x00 }, 0, { 0xBE, 0x00 }, 1, 9, 3, true,  DecodeDS18B20, IsPowerOnValueDS18B20 },
+    { W1::FamilyCode::DS1822,  0x44, 750000, { 0x00, 0x00 }, 0, { 0xBE, 0x00 }, 1, 9, 3, true,  DecodeDS18B20, IsPowerOnValueDS18B20 },
+    { W1::FamilyCode::DS18S20, 0x44, 750000, { 0x00, 0x00 }, 0, { 0xBE, 0x00 }, 1, 9, 2, true,  DecodeDS18S20, IsPowerOnValueDS18S20 },
+    { W1::FamilyCode::DS2438,  0x44, 10000,  { 0xB8, 0x00 }, 2, { 0xBE, 0x00 }, 2, 9, 0, false, DecodeDS2438,  nullptr },
+    { W1::FamilyCode::DS2401,  0x00, 0,      { 0x00, 0x00 }, 0, { 0x00, 0x00 }, 0, 0, 0, false, nullptr,       nullptr },
+};
+
+uint8_t W1::DeviceFamilyRegistry::Find(uint64_t address)
+{
+    uint8_t familyCode = address & 0xFF;
+    for (uint8_t i = 0; i < sizeof(families) / sizeof(families[0]); i++)
+    {
+        if (families[i].familyCode == familyCode)
+            return i;
+    }
+    return C_UnknownFamily;
+}
+
+const W1::DeviceFamily & W1::DeviceFamilyRegistry::Get(uint8_t index)
+{
+    ASSERT(index < sizeof(families) / sizeof(families[0]));
+    return families[index];
+}
@@ -0,0 +1,49 @@
+#ifndef DEVICEFAMILY_H_92c4e07b1d5a
+#define DEVICEFAMILY_H_92c4e07b1d5a
+
+#include <cstdint>
+
+namespace W1
+{
+    class FamilyCode
+    {
+    public:
+        static const uint8_t DS2401 = 0x01;
+        static const uint8_t DS18S20 = 0x10;
+        static const uint8_t DS1822 = 0x22;
+        static const uint8_t DS2438 = 0x26;
+        static const uint8_t DS18B20 = 0x28;
+    };
+
+    // Description of a 1-wire device type (selected by family code = lowest byte of ROM code).
+    // Commands are sent after Match ROM, read data starts right after the read command.
+    struct DeviceFamily
+    {
+        uint8_t familyCode;
+        uint8_t convertCommand;      // broadcast (Skip ROM) before readout, sent by Match ROM for reconversion, 0 = nothing to convert
+        uint32_t conversionTimeUs;   // maximal conversion time (12 bit resolution for devices with configuration register)
+        uint8_t recallCommand[2];    // separate transaction before readout (copies data to scratchpad)
+        uint8_t recallCommandLength; // 0 = no recall
+        uint8_t readCommand[2];
+        uint8_t readCommandLength;   // 0 = device has no readout (ID only)
+        uint8_t readLength;          // read bytes including CRC
+        uint8_t configurationLength; // bytes written by Write Scratchpad: 0 = none, 2 = TH TL, 3 = TH TL configuration register
+        bool isAlarmSearchSupported;
+        int16_t (*decodeTemperature)(const uint8_t * data); // [1/256 °C], data = first read byte
+        bool (*isPowerOnValue)(const uint8_t * data);       // power-on reset content (conversion was interrupted), nullptr = not detectable
+    };
+
+    class DeviceFamilyRegistry
+    {
+        public:
+            static const uint8_t C_UnknownFamily = 0xFF;
+
+            static uint8_t Find(uint64_t address); // index of device family, C_UnknownFamily if not supported
+            static const DeviceFamily & Get(uint8_t index);
+
+        private:
+            static const DeviceFamily families[];
+    };
+}
+
+#endif
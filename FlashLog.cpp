@@ -0,0 +1,258 @@
+#include "FlashLog.h"
+#include "MonotonicClock.h"
+#include <cstring>
+
+extern "C"
+{
+#include "nrf_assert.h"
+#include "nrf_log.h"
+}
+
+FS_REGISTER_CFG(fs_config_t flashLogFsConfig) =
+{
+    FlashLog::FsEventHandlerStatic, // callback
+    FlashLog::C_PageCount,          // num_pages
+    0xFD,                           // priority (after ROM code cache)
+    nullptr,                        // p_start_addr (assigned by fs_init)
+    nullptr                         // p_end_addr (assigned by fs_init)
+};
+
+FlashLog::FlashLog()
+    : state(FlashLogState::Idle), headPage(C_PageCount), headSlot(0), oldestPage(0), usedPages(0), sequence(0), pendingCount(0), writingCount(0), pendingTime(0)
+{
+}
+
+const uint32_t *FlashLog::GetPage(uint8_t page)
+{
+    return flashLogFsConfig.p_start_addr + page * FS_PAGE_SIZE_WORDS;
+}
+
+bool FlashLog::IsPageValid(uint8_t page)
+{
+    return GetPage(page)[0] == C_Magic;
+}
+
+bool FlashLog::IsSlotFree(uint8_t page, uint8_t slot)
+{
+    // address of a written record is never erased value (CRC of ROM code)
+    const uint32_t *record = GetPage(page) + C_HeaderLengthWords + slot * C_RecordLengthWords;
+    return record[0] == 0xFFFFFFFF && record[1] == 0xFFFFFFFF;
+}
+
+void FlashLog::Init()
+{
+    if (flashLogFsConfig.p_start_addr == nullptr)
+        return;
+
+    uint8_t head;
+    if (!IsPageValid(0))
+    {
+        // empty log or interrupted rotation to page 0 (all other pages are valid then)
+        if (!IsPageValid(C_PageCount - 1))
+            return;
+        head = C_PageCount - 1;
+    }
+    else
+    {
+        // pages of the current lap are valid and numbered from page 0 => binary search of the last one
+        uint32_t firstSequence = GetPage(0)[1];
+        uint8_t low = 0;
+        uint8_t high = C_PageCount;
+        while (high - low > 1)
+        {
+            uint8_t middle = (low + high) >> 1;
+            if (IsPageValid(middle) && GetPage(middle)[1] == firstSequence + middle)
+            {
+                low = middle;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+        head = low;
+    }
+    this->headPage = head;
+    this->sequence = GetPage(head)[1];
+
+    // oldest page follows the head (one page can be invalid after interrupted rotation), in the first lap it is page 0
+    this->oldestPage = IsPageValid(0) ? 0 : head;
+    for (uint8_t i = 1; i <= 2; i++)
+    {
+        uint8_t page = (head + i) % C_PageCount;
+        if (page != head && IsPageValid(page) && this->sequence - GetPage(page)[1] < C_PageCount)
+        {
+            this->oldestPage = page;
+            break;
+        }
+    }
+    this->usedPages = this->sequence - GetPage(this->oldestPage)[1] + 1;
+
+    // slots are written in order => binary search of the first free one
+    uint8_t low = 0;
+    uint8_t high = C_RecordsPerPage;
+    while (low < high)
+    {
+        uint8_t middle = (low + high) >> 1;
+        if (IsSlotFree(head, middle))
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+    this->headSlot = low;
+
+    NRF_LOG_INFO("Flash log: %u pages, head %u, slot %u\r\n", this->usedPages, head, low);
+}
+
+bool FlashLog::Append(const HistoryBlock &block)
+{
+    if (this->state == FlashLogState::Writing || this->pendingCount >= C_BatchCount)
+        return false;
+
+    memcpy(&this->pending[this->pendingCount], &block, sizeof(HistoryBlock));
+    if (this->pendingCount == 0)
+    {
+        this->pendingTime = MonotonicClock::Now();
+    }
+    if (++this->pendingCount == C_BatchCount && this->state == FlashLogState::Idle)
+    {
+        this->state = FlashLogState::FlushPending;
+    }
+    return true;
+}
+
+uint8_t FlashLog::GetNextPage()
+{
+    return this->headPage + 1 < C_PageCount ? this->headPage + 1 : 0;
+}
+
+// Queues the next flash operation of the flush, it is retried by the next DoWork if the fstorage queue is full.
+// Completed operations only advance the state, so each operation is queued after checking isIdle.
+void FlashLog::DoWork(bool isIdle)
+{
+    if (!isIdle || flashLogFsConfig.p_start_addr == nullptr)
+        return;
+
+    // lone record is not kept in RAM for long (lost by reset)
+    if (this->state == FlashLogState::Idle && this->pendingCount &&
+        MonotonicClock::Now() - this->pendingTime >= C_FlushTimeoutS * MonotonicClock::C_TicksPerSecond)
+    {
+        this->state = FlashLogState::FlushPending;
+    }
+
+    fs_ret_t res = FS_SUCCESS;
+    FlashLogState startedState = this->state;
+    if (startedState == FlashLogState::FlushPending && (this->headPage >= C_PageCount || this->headSlot >= C_RecordsPerPage))
+    {
+        // rotation: next page is erased (oldest data is lost when the ring is full), header marks it valid
+        this->header[0] = C_Magic;
+        this->header[1] = this->sequence + 1;
+        this->state = FlashLogState::Erasing;
+        res = fs_erase(&flashLogFsConfig, GetPage(this->GetNextPage()), 1, this);
+    }
+    else if (startedState == FlashLogState::FlushPending)
+    {
+        // batch is written by single operation, records not fitting to the page are written after next rotation
+        uint8_t count = C_RecordsPerPage - this->headSlot;
+        if (count > this->pendingCount)
+        {
+            count = this->pendingCount;
+        }
+        const uint32_t *destination = GetPage(this->headPage) + C_HeaderLengthWords + this->headSlot * C_RecordLengthWords;
+        this->writingCount = count;
+        this->state = FlashLogState::Writing;
+        res = fs_store(&flashLogFsConfig, destination, reinterpret_cast<const uint32_t *>(this->pending), count * C_RecordLengthWords, this);
+        if (res == FS_SUCCESS)
+        {
+            this->headSlot += count;
+        }
+    }
+    else if (startedState == FlashLogState::StoreHeader)
+    {
+        this->state = FlashLogState::StoringHeader;
+        res = fs_store(&flashLogFsConfig, GetPage(this->GetNextPage()), this->header, C_HeaderLengthWords, this);
+    }
+    else
+    {
+        return;
+    }
+
+    if (res != FS_SUCCESS)
+    {
+        // fstorage queue is full (other module), try again later
+        this->state = startedState;
+        NRF_LOG_WARNING("Flash log: flash operation not queued (%d)\r\n", res);
+    }
+}
+
+uint16_t FlashLog::GetRecordCount()
+{
+    if (this->usedPages == 0)
+        return 0;
+    return (this->usedPages - 1) * C_RecordsPerPage + this->headSlot;
+}
+
+const HistoryBlock *FlashLog::GetRecord(uint16_t index)
+{
+    ASSERT(index < this->GetRecordCount());
+    uint8_t page = (this->oldestPage + index / C_RecordsPerPage) % C_PageCount;
+    uint8_t slot = index % C_RecordsPerPage;
+    if (IsSlotFree(page, slot))
+        return nullptr;
+    return reinterpret_cast<const HistoryBlock *>(GetPage(page) + C_HeaderLengthWords + slot * C_RecordLengthWords);
+}
+
+void FlashLog::FsEventHandlerStatic(fs_evt_t const *const evt, fs_ret_t result)
+{
+    static_cast<FlashLog *>(evt->p_context)->FsEventHandler(evt, result);
+}
+
+void FlashLog::FsEventHandler(fs_evt_t const *const evt, fs_ret_t result)
+{
+    if (result != FS_SUCCESS)
+    {
+        // content of the head page is uncertain (or rotation did not complete), continue on a fresh page
+        NRF_LOG_ERROR("Flash log: flash operation failed (%d)\r\n", result);
+        this->headSlot = C_RecordsPerPage;
+    }
+
+    if (this->state == FlashLogState::Erasing && evt->id == FS_EVT_ERASE)
+    {
+        this->state = result == FS_SUCCESS ? FlashLogState::StoreHeader : FlashLogState::FlushPending;
+    }
+    else if (this->state == FlashLogState::StoringHeader && evt->id == FS_EVT_STORE && evt->store.p_data == this->header)
+    {
+        if (result == FS_SUCCESS)
+        {
+            uint8_t next = this->GetNextPage();
+            if (this->usedPages == C_PageCount)
+            {
+                this->oldestPage = next + 1 < C_PageCount ? next + 1 : 0;
+            }
+            else
+            {
+                if (this->usedPages == 0)
+                {
+                    this->oldestPage = next;
+                }
+                this->usedPages++;
+            }
+            this->headPage = next;
+            this->headSlot = 0;
+            this->sequence++;
+        }
+        this->state = FlashLogState::FlushPending;
+    }
+    else if (this->state == FlashLogState::Writing && evt->id == FS_EVT_STORE && evt->store.p_data == reinterpret_cast<const uint32_t *>(this->pending))
+    {
+        // written records (or lost by failure) are removed from the batch
+        this->pendingCount -= this->writingCount;
+        memmove(&this->pending[0], &this->pending[this->writingCount], this->pendingCount * sizeof(HistoryBlock));
+        this->writingCount = 0;
+        this->state = this->pendingCount ? FlashLogState::FlushPending : FlashLogState::Idle;
+    }
+}
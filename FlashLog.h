@@ -0,0 +1,67 @@
+#ifndef FLASHLOG_H_6b20e4d9a7f3
+#define FLASHLOG_H_6b20e4d9a7f3
+
+#include <cstdint>
+#include "app_global.h"
+#include "MeasurementHistory.h"
+
+extern "C"
+{
+#include "fstorage.h"
+}
+
+enum class FlashLogState
+{
+    Idle,         // collecting records
+    FlushPending, // batch is complete, waiting for DoWork while measurement is not running (one operation is queued at a time)
+    Erasing,      // rotation to the next page
+    StoreHeader,  // header marks the erased page valid
+    StoringHeader,
+    Writing
+};
+
+// Append-only log of sealed history blocks in a ring of flash pages (fstorage). Pages are erased in rotation, so each
+// page is erased once per lap (wear levelling), the oldest page is dropped when the ring is full.
+// Page layout (words): [0] magic, [1] sequence number (+1 per page), [2..] records (HistoryBlock), erased slot = free
+class FlashLog
+{
+public:
+    static const uint32_t C_Magic = 0x474F4C31; // "LOG1"
+    static const uint8_t C_PageCount = FLASH_LOG_PAGE_COUNT;
+    static const uint16_t C_HeaderLengthWords = 2;
+    static const uint16_t C_RecordLengthWords = HistoryBlock::C_Size / sizeof(uint32_t);
+    static const uint8_t C_RecordsPerPage = (FS_PAGE_SIZE_WORDS - C_HeaderLengthWords) / C_RecordLengthWords;
+    static const uint8_t C_BatchCount = 2; // records written by one flash operation
+    static const uint32_t C_FlushTimeoutS = 10 * 60; // incomplete batch is written after this time
+
+    FlashLog();
+    void Init();                           // call after fs_init, locates the write head (binary search, no full scan)
+    bool Append(const HistoryBlock &block); // record is copied, false = batch is being written or full (offer it again later)
+    // call from main loop, each flash operation is queued only when isIdle (no measurement running), a measurement
+    // started later may still wait for the queued operation
+    void DoWork(bool isIdle);
+    uint16_t GetRecordCount();
+    const HistoryBlock *GetRecord(uint16_t index); // 0 = oldest, nullptr = slot was not written (failed write)
+    static void FsEventHandlerStatic(fs_evt_t const *const evt, fs_ret_t result);
+
+private:
+    void FsEventHandler(fs_evt_t const *const evt, fs_ret_t result);
+    uint8_t GetNextPage();
+    static const uint32_t *GetPage(uint8_t page);
+    static bool IsPageValid(uint8_t page);
+    static bool IsSlotFree(uint8_t page, uint8_t slot);
+
+    volatile FlashLogState state;
+    uint8_t headPage;   // page written now, C_PageCount = log is empty
+    uint8_t headSlot;   // first free slot of the head page
+    uint8_t oldestPage;
+    uint8_t usedPages;
+    uint32_t sequence;  // of the head page
+    uint32_t header[C_HeaderLengthWords]; // must stay valid until fstorage completes the write
+    HistoryBlock pending[C_BatchCount];
+    uint8_t pendingCount;
+    uint8_t writingCount; // pending records being written
+    uint32_t pendingTime; // [MonotonicClock ticks] first record of the batch was appended
+};
+
+#endif
@@ -0,0 +1,217 @@
+#include "MeasurementHistory.h"
+#include "MonotonicClock.h"
+
+static uint32_t ZigZagEncode(int32_t value)
+{
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+static int32_t ZigZagDecode(uint32_t value)
+{
+    return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+}
+
+// 7 bits per byte from LSB, highest bit = more bytes follow
+static bool ReadVarint(const uint8_t *data, uint8_t length, uint8_t &position, uint32_t &value)
+{
+    value = 0;
+    for (uint8_t shift = 0; position < length && shift < 32; shift += 7)
+    {
+        uint8_t byte = data[position++];
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+HistoryBlockReader::HistoryBlockReader(const HistoryBlock &block) : block(block), index(0), position(0), timeOffset(0), value(block.startValue)
+{
+}
+
+bool HistoryBlockReader::Next(uint32_t &time, int16_t &temperature)
+{
+    if (this->index >= this->block.count)
+        return false;
+
+    if (this->index > 0)
+    {
+        uint32_t timeDelta;
+        uint32_t valueDelta;
+        if (!ReadVarint(this->block.data, this->block.length, this->position, timeDelta) ||
+            !ReadVarint(this->block.data, this->block.length, this->position, valueDelta))
+            return false;
+        this->timeOffset += timeDelta;
+        this->value += ZigZagDecode(valueDelta);
+    }
+    this->index++;
+
+    time = this->block.startTime + this->timeOffset * MonotonicClock::C_TicksPerSecond;
+    temperature = this->value << HistoryBlock::C_ValueShift;
+    return true;
+}
+
+MeasurementHistory::MeasurementHistory() : head(C_BlockCount - 1), usedCount(0), droppedCount(0), sealedHandler(nullptr), sealedContext(nullptr)
+{
+    for (uint8_t i = 0; i < C_BlockCount; i++)
+    {
+        this->blocks[i].address = 0;
+    }
+}
+
+void MeasurementHistory::SetBlockSealedHandler(bool (*handler)(const HistoryBlock &block, void *context), void *context)
+{
+    this->sealedHandler = handler;
+    this->sealedContext = context;
+}
+
+void MeasurementHistory::Seal(uint8_t blockIndex)
+{
+    if (this->sealedHandler)
+    {
+        this->isSealPending.Set(blockIndex, true);
+        this->DoWork();
+    }
+}
+
+// Sealed blocks are offered from the oldest, order is kept (stops at the first rejected block)
+void MeasurementHistory::DoWork()
+{
+    uint8_t oldest = (this->head + 1 + C_BlockCount - this->usedCount) % C_BlockCount;
+    for (uint8_t i = 0; i < this->usedCount; i++)
+    {
+        uint8_t index = (oldest + i) % C_BlockCount;
+        if (!this->isSealPending.IsSet(index))
+            continue;
+        if (!this->sealedHandler(this->blocks[index], this->sealedContext))
+            return;
+        this->isSealPending.Set(index, false);
+    }
+}
+
+uint16_t MeasurementHistory::GetDroppedCount()
+{
+    return this->droppedCount;
+}
+
+uint8_t MeasurementHistory::GetBlockCount()
+{
+    return this->usedCount;
+}
+
+const HistoryBlock &MeasurementHistory::GetBlock(uint8_t index)
+{
+    uint16_t oldest = this->head + 1 + C_BlockCount - this->usedCount;
+    return this->blocks[(oldest + index) % C_BlockCount];
+}
+
+// Newest block of the sensor (blocks of other sensors may follow it)
+HistoryBlock *MeasurementHistory::FindOpenBlock(uint64_t address)
+{
+    for (uint8_t i = 0; i < this->usedCount; i++)
+    {
+        HistoryBlock &block = this->blocks[(this->head + C_BlockCount - i) % C_BlockCount];
+        if (block.address == address)
+            return &block;
+    }
+    return nullptr;
+}
+
+// Oldest block of the full ring is open when no newer block of the same sensor exists
+bool MeasurementHistory::IsOldestOpen()
+{
+    uint8_t oldest = (this->head + 1) % C_BlockCount;
+    for (uint8_t i = 1; i < C_BlockCount; i++)
+    {
+        if (this->blocks[(oldest + i) % C_BlockCount].address == this->blocks[oldest].address)
+            return false;
+    }
+    return true;
+}
+
+HistoryBlock &MeasurementHistory::StartBlock(uint64_t address, uint32_t time, int16_t value)
+{
+    uint8_t oldest = (this->head + 1) % C_BlockCount;
+    if (this->usedCount < C_BlockCount)
+    {
+        this->usedCount++;
+    }
+    else
+    {
+        if (this->blocks[oldest].address != address && this->IsOldestOpen())
+        {
+            // oldest block is still open (other sensor), it is sealed before it is overwritten
+            this->Seal(oldest);
+        }
+        if (this->isSealPending.IsSet(oldest))
+        {
+            this->DoWork();
+        }
+        if (this->isSealPending.IsSet(oldest))
+        {
+            // log is busy for the whole ring
+            this->isSealPending.Set(oldest, false);
+            this->droppedCount++;
+        }
+    }
+    this->head = oldest;
+
+    HistoryBlock &block = this->blocks[this->head];
+    block.address = address;
+    block.startTime = time;
+    block.startValue = value;
+    block.lastValue = value;
+    block.lastTimeOffset = 0;
+    block.count = 1;
+    block.length = 0;
+    return block;
+}
+
+uint8_t MeasurementHistory::WriteVarint(uint8_t *data, uint32_t value)
+{
+    uint8_t length = 0;
+    while (value >= 0x80)
+    {
+        data[length++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    data[length++] = value;
+    return length;
+}
+
+// Returns false if the record doesn't fit to the block (data full, time offset overflow, out of order time)
+bool MeasurementHistory::AppendRecord(HistoryBlock &block, uint32_t timeOffset, int16_t value)
+{
+    if (timeOffset < block.lastTimeOffset || timeOffset > 0xFFFF || block.count == 0xFF)
+        return false;
+
+    uint8_t record[10];
+    uint8_t length = WriteVarint(record, timeOffset - block.lastTimeOffset);
+    length += WriteVarint(record + length, ZigZagEncode(value - block.lastValue));
+    if (block.length + length > sizeof(block.data))
+        return false;
+
+    for (uint8_t i = 0; i < length; i++)
+    {
+        block.data[block.length + i] = record[i];
+    }
+    block.length += length;
+    block.lastTimeOffset = timeOffset;
+    block.lastValue = value;
+    block.count++;
+    return true;
+}
+
+void MeasurementHistory::Append(uint64_t address, uint32_t time, int16_t temperature)
+{
+    int16_t value = temperature >> HistoryBlock::C_ValueShift;
+    HistoryBlock *block = this->FindOpenBlock(address);
+    if (block && this->AppendRecord(*block, (time - block->startTime) / MonotonicClock::C_TicksPerSecond, value))
+        return;
+
+    if (block)
+    {
+        this->Seal(block - this->blocks);
+    }
+    this->StartBlock(address, time, value);
+}
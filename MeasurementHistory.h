@@ -0,0 +1,76 @@
+#ifndef MEASUREMENTHISTORY_H_1f7c93a0e6d2
+#define MEASUREMENTHISTORY_H_1f7c93a0e6d2
+
+#include <cstdint>
+#include "app_global.h"
+#include "BitSet.h"
+
+// Readings of one sensor: keyframe (absolute time and value) followed by records of zigzag varint deltas
+// (time delta [s], value delta [1/16 °C]), typically 2 bytes per record
+struct HistoryBlock
+{
+    static const uint8_t C_Size = 64;
+    static const uint8_t C_ValueShift = 4; // stored resolution: 1/256 °C >> 4 = 1/16 °C (12 bit sensor LSB)
+
+    uint64_t address;        // sensor ROM code, 0 = unused block
+    uint32_t startTime;      // [MonotonicClock ticks] of the keyframe
+    int16_t startValue;      // [1/16 °C] keyframe
+    int16_t lastValue;       // [1/16 °C] last record (next delta base)
+    uint16_t lastTimeOffset; // [s] last record from startTime
+    uint8_t count;           // records including keyframe
+    uint8_t length;          // used bytes of data
+    uint8_t data[C_Size - 20];
+};
+
+static_assert(sizeof(HistoryBlock) == HistoryBlock::C_Size, "HistoryBlock layout");
+
+// Decodes records of one block from the oldest
+class HistoryBlockReader
+{
+public:
+    HistoryBlockReader(const HistoryBlock &block);
+    bool Next(uint32_t &time, int16_t &temperature); // [MonotonicClock ticks], [1/256 °C], false = no more records
+
+private:
+    const HistoryBlock &block;
+    uint8_t index;
+    uint8_t position;
+    uint32_t timeOffset;
+    int32_t value;
+};
+
+// RAM ring of history blocks shared by all sensors, the oldest block is overwritten when the ring is full (an open
+// block is sealed first). Sealed blocks rejected by the handler (log busy) stay in the ring and are offered again.
+// Handler returns false = block not taken, it is offered again by the next DoWork or Append.
+class MeasurementHistory
+{
+public:
+    static const uint8_t C_BlockCount = MEASUREMENT_HISTORY_SIZE / HistoryBlock::C_Size;
+    static_assert(C_BlockCount >= 2 && C_BlockCount >= ONE_WIRE_MAX_DEVICE_COUNT, "MEASUREMENT_HISTORY_SIZE too small (one open block per sensor)");
+
+    MeasurementHistory();
+    void Append(uint64_t address, uint32_t time, int16_t temperature); // [MonotonicClock ticks], [1/256 °C]
+    uint8_t GetBlockCount();                                           // used blocks
+    const HistoryBlock &GetBlock(uint8_t index);                       // 0 = oldest block
+    void SetBlockSealedHandler(bool (*handler)(const HistoryBlock &block, void *context), void *context); // called when block is full
+    void DoWork();             // call from main loop, offers sealed blocks rejected by the handler again
+    uint16_t GetDroppedCount(); // sealed blocks overwritten before the handler took them
+
+private:
+    HistoryBlock *FindOpenBlock(uint64_t address);
+    bool IsOldestOpen();
+    HistoryBlock &StartBlock(uint64_t address, uint32_t time, int16_t value);
+    void Seal(uint8_t blockIndex);
+    static bool AppendRecord(HistoryBlock &block, uint32_t timeOffset, int16_t value);
+    static uint8_t WriteVarint(uint8_t *data, uint32_t value);
+
+    HistoryBlock blocks[C_BlockCount];
+    uint8_t head; // newest block
+    uint8_t usedCount;
+    BitSet<C_BlockCount> isSealPending; // sealed, not yet taken by the handler
+    uint16_t droppedCount;
+    bool (*sealedHandler)(const HistoryBlock &block, void *context);
+    void *sealedContext;
+};
+
+#endif
@@ -0,0 +1,25 @@
+#include "MonotonicClock.h"
+
+extern "C"
+{
+#include "nrf.h"
+}
+
+volatile uint32_t MonotonicClock::lastTime = 0;
+
+// Time advances from the last returned value by the counter difference (modulo 24 bits). The last value is read before
+// the counter, so a context preempting between the two reads can only store a value older than the counter. Storing
+// a slightly older value after preemption is harmless, all stored values stay within one counter period.
+uint32_t MonotonicClock::Now()
+{
+    uint32_t last = lastTime;
+    uint32_t counter = NRF_RTC1->COUNTER;
+    uint32_t now = last + ((counter - last) & C_CounterMask);
+    lastTime = now;
+    return now;
+}
+
+uint32_t MonotonicClock::ToMilliseconds(uint32_t ticks)
+{
+    return static_cast<uint64_t>(ticks) * 1000 / C_TicksPerSecond;
+}
@@ -0,0 +1,23 @@
+#ifndef MONOTONICCLOCK_H_d3a61f08e95b
+#define MONOTONICCLOCK_H_d3a61f08e95b
+
+#include <cstdint>
+#include "app_global.h"
+
+// 32-bit time extended from the 24-bit RTC1 counter (running for app_timer), callable from any context without locking.
+// Now() has to be called at least once per RTC1 overflow period (512 s with prescaler 0), the measurement timer calls
+// it every MEASUREMENT_INTERVAL_MS. 32-bit value overflows after 36 hours => compare timestamps by difference.
+class MonotonicClock
+{
+public:
+    static const uint32_t C_TicksPerSecond = 32768 / (TIMER_LIB_PRESCALER + 1);
+
+    static uint32_t Now(); // [ticks]
+    static uint32_t ToMilliseconds(uint32_t ticks);
+
+private:
+    static const uint32_t C_CounterMask = 0x00FFFFFF;
+    static volatile uint32_t lastTime;
+};
+
+#endif
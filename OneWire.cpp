@@ -31,19 +31,19 @@ void W1::BitBlock::Set(uint8_t index, bool value)
 void W1::BitBlock::SetOne(uint8_t index)
 {
     ASSERT(index < C_BitsCount);
-    this->Data[index / 8] |= (1 << (index % 8));
+    this->Words[index >> 5] |= (1UL << (index & 31));
 }
 
 void W1::BitBlock::SetZero(uint8_t index)
 {
     ASSERT(index < C_BitsCount);
-    this->Data[index / 8] &= ~(1 << (index % 8));
+    this->Words[index >> 5] &= ~(1UL << (index & 31));
 }
 
 bool W1::BitBlock::IsOne(uint8_t index)
 {
     ASSERT(index < C_BitsCount);
-    return this->Data[index / 8] & (1 << (index % 8));
+    return (this->Words[index >> 5] >> (index & 31)) & 1;
 }
 
 bool W1::BitBlock::IsZero(uint8_t index)
@@ -54,8 +54,8 @@ bool W1::BitBlock::IsZero(uint8_t index)
 
 void W1::BitBlock::Clear()
 {
-    for (int8_t i = 0; i < C_BytesCount; i++)
-        this->Data[i] = 0;
+    for (int8_t i = 0; i < C_WordsCount; i++)
+        this->Words[i] = 0;
 }
 
 uint64_t W1::BitBlock::ToUInt64(uint8_t byteIndex)
@@ -81,53 +81,61 @@ void W1::BitBlock::FromUInt64(uint64_t value, uint8_t byteIndex)
     }
 }
 
-uint8_t W1::Crc::Compute(uint8_t * data, uint16_t length)
+W1::OneWirePhysicalLayer::OneWirePhysicalLayer(uint8_t pinNumber) : pinMask(1UL << pinNumber), laneCount(1), isStrongPullUp(false)
 {
-    uint8_t crc = 0;
-
-    while (length--) {
-        crc = lookupTable[(crc ^ *data++)];
-    }
-	return crc;
+    this->laneMasks[0] = this->pinMask;
+    this->pinNumbers[0] = pinNumber;
+    this->Configure();
 }
 
-uint8_t W1::Crc::Compute(BitBlock & data, uint8_t firstByte, uint8_t length)
+W1::OneWirePhysicalLayer::OneWirePhysicalLayer(const uint8_t * pinNumbers, uint8_t laneCount) : pinMask(0), laneCount(laneCount), isStrongPullUp(false)
 {
-    return W1::Crc::Compute(data.Data + firstByte, length);
+    ASSERT(laneCount > 0 && laneCount <= C_MaxLanes);
+    for (uint8_t i = 0; i < laneCount; i++)
+    {
+        this->pinNumbers[i] = pinNumbers[i];
+        this->laneMasks[i] = 1UL << pinNumbers[i];
+        this->pinMask |= this->laneMasks[i];
+    }
+    this->Configure();
 }
 
-const uint8_t  W1::Crc::lookupTable[] = {
-      0, 94,188,226, 97, 63,221,131,194,156,126, 32,163,253, 31, 65,
-    157,195, 33,127,252,162, 64, 30, 95,  1,227,189, 62, 96,130,220,
-     35,125,159,193, 66, 28,254,160,225,191, 93,  3,128,222, 60, 98,
-    190,224,  2, 92,223,129, 99, 61,124, 34,192,158, 29, 67,161,255,
-     70, 24,250,164, 39,121,155,197,132,218, 56,102,229,187, 89,  7,
-    219,133,103, 57,186,228,  6, 88, 25, 71,165,251,120, 38,196,154,
-    101, 59,217,135,  4, 90,184,230,167,249, 27, 69,198,152,122, 36,
-    248,166, 68, 26,153,199, 37,123, 58,100,134,216, 91,  5,231,185,
-    140,210, 48,110,237,179, 81, 15, 78, 16,242,172, 47,113,147,205,
-     17, 79,173,243,112, 46,204,146,211,141,111, 49,178,236, 14, 80,
-    175,241, 19, 77,206,144,114, 44,109, 51,209,143, 12, 82,176,238,
-     50,108,142,208, 83, 13,239,177,240,174, 76, 18,145,207, 45,115,
-    202,148,118, 40,171,245, 23, 73,  8, 86,180,234,105, 55,213,139,
-     87,  9,235,181, 54,104,138,212,149,203, 41,119,244,170, 72, 22,
-    233,183, 85, 11,136,214, 52,106, 43,117,151,201, 74, 20,246,168,
-    116, 42,200,150, 21, 75,169,247,182,232, 10, 84,215,137,107, 53
-    };
-
-W1::OneWirePhysicalLayer::OneWirePhysicalLayer(uint8_t pinNumber) : pinNumber(pinNumber)
+// H0D1 = open drain (normal operation), H0H1 = push-pull with high drive (strong pull-up)
+void W1::OneWirePhysicalLayer::Configure()
 {
+    nrf_gpio_pin_drive_t drive = this->isStrongPullUp ? NRF_GPIO_PIN_H0H1 : NRF_GPIO_PIN_H0D1;
     this->Release();
-    nrf_gpio_cfg(this->pinNumber, NRF_GPIO_PIN_DIR_OUTPUT, NRF_GPIO_PIN_INPUT_CONNECT, NRF_GPIO_PIN_NOPULL, NRF_GPIO_PIN_H0D1,NRF_GPIO_PIN_NOSENSE);
+    for (uint8_t i = 0; i < this->laneCount; i++)
+    {
+        nrf_gpio_cfg(this->pinNumbers[i], NRF_GPIO_PIN_DIR_OUTPUT, NRF_GPIO_PIN_INPUT_CONNECT, NRF_GPIO_PIN_NOPULL, drive, NRF_GPIO_PIN_NOSENSE);
+    }
     if (C_driveDebugPin)
     {
         nrf_gpio_cfg_output(C_debugPinNumber);
     }
 }
 
+// called right after the last bit of Convert T / Copy Scratchpad, only the drive field of lane pins is changed
+void W1::OneWirePhysicalLayer::SetStrongPullUp(bool enable)
+{
+    uint32_t drive = (enable ? GPIO_PIN_CNF_DRIVE_H0H1 : GPIO_PIN_CNF_DRIVE_H0D1) << GPIO_PIN_CNF_DRIVE_Pos;
+    this->isStrongPullUp = enable;
+    this->Release();
+    for (uint8_t i = 0; i < this->laneCount; i++)
+    {
+        uint8_t pin = this->pinNumbers[i];
+        NRF_GPIO->PIN_CNF[pin] = (NRF_GPIO->PIN_CNF[pin] & ~GPIO_PIN_CNF_DRIVE_Msk) | drive;
+    }
+}
+
+bool W1::OneWirePhysicalLayer::IsStrongPullUp()
+{
+    return this->isStrongPullUp;
+}
+
 void W1::OneWirePhysicalLayer::PullDown()
 {
-    nrf_gpio_pin_clear(this->pinNumber);
+    nrf_gpio_pins_clear(this->pinMask);
     if (C_driveDebugPin)
     {
         nrf_gpio_pin_clear(C_debugPinNumber);
@@ -136,9 +144,13 @@ void W1::OneWirePhysicalLayer::PullDown()
 
 void W1::OneWirePhysicalLayer::Release()
 {
-    nrf_gpio_pin_set(this->pinNumber);
-    //nrf_gpio_cfg_input(this->pinNumber, NRF_GPIO_PIN_NOPULL);
-    if (C_driveDebugPin)
+    this->Release(this->pinMask);
+}
+
+void W1::OneWirePhysicalLayer::Release(uint32_t pinMask)
+{
+    nrf_gpio_pins_set(pinMask);
+    if (C_driveDebugPin && pinMask == this->pinMask)
     {
         nrf_gpio_pin_set(C_debugPinNumber);
     }
@@ -146,10 +158,46 @@ void W1::OneWirePhysicalLayer::Release()
 
 bool W1::OneWirePhysicalLayer::Read()
 {
-    return nrf_gpio_pin_read(this->pinNumber) != 0;
+    return (nrf_gpio_pins_read() & this->laneMasks[0]) != 0;
+}
+
+uint32_t W1::OneWirePhysicalLayer::ReadAll()
+{
+    return nrf_gpio_pins_read() & this->pinMask;
 }
 
-W1::OneWireResetSequence::OneWireResetSequence(W1::OneWirePhysicalLayer &w1) : state(W1::OneWireResetSequenceState::Idle), w1(w1), isSlavePresent(false)
+uint32_t W1::OneWirePhysicalLayer::GetLaneMask(uint8_t lane)
+{
+    ASSERT(lane < this->laneCount);
+    return this->laneMasks[lane];
+}
+
+uint32_t W1::OneWirePhysicalLayer::GetPinMask()
+{
+    return this->pinMask;
+}
+
+uint8_t W1::OneWirePhysicalLayer::GetLaneCount()
+{
+    return this->laneCount;
+}
+
+void W1::OneWireDiagnostics::Clear()
+{
+    this->lastFault = W1::OneWireFault::None;
+    this->lastRiseTimeUs = 0;
+    this->maxRiseTimeUs = 0;
+    this->resetCount = 0;
+    this->shortCount = 0;
+    this->stuckLowCount = 0;
+    this->slowRiseCount = 0;
+    this->noPresenceCount = 0;
+    this->slotLowCount = 0;
+}
+
+W1::OneWireResetSequence::OneWireResetSequence(W1::OneWirePhysicalLayer &w1, W1::OneWireDiagnostics &diagnostics)
+    : state(W1::OneWireResetSequenceState::Idle), w1(w1), diagnostics(diagnostics), presenceMask(0), idleLevels(0), riseTimeUs(0),
+      isRiseTimeMeasured(false)
 {
 }
 
@@ -158,15 +206,74 @@ bool W1::OneWireResetSequence::IsReady()
     return this->state == W1::OneWireResetSequenceState::Idle;
 }
 
-void W1::OneWireResetSequence::Run()
+void W1::OneWireResetSequence::Run(bool measureRiseTime)
 {
     ASSERT(this->IsReady());
+    this->isRiseTimeMeasured = measureRiseTime || this->diagnostics.isEnabled;
     this->state = W1::OneWireResetSequenceState::Begin;
 }
 
-bool W1::OneWireResetSequence::IsSlavePresent()
+uint32_t W1::OneWireResetSequence::GetRiseTimeUs()
 {
-    return this->isSlavePresent;
+    return this->riseTimeUs;
+}
+
+bool W1::OneWireResetSequence::IsSlavePresent(uint8_t lane)
+{
+    return (this->presenceMask & this->w1.GetLaneMask(lane)) != 0;
+}
+
+// Spins until all lanes are high after release, returns elapsed time (C_RiseTimeTimeoutUs = timeout)
+uint32_t W1::OneWireResetSequence::MeasureRiseTime(TS::TimeslotInfo &timeslotInfo)
+{
+    const uint32_t pinMask = this->w1.GetPinMask();
+    uint32_t start = timeslotInfo.GetTicks();
+    uint32_t elapsed = 0;
+    while (this->w1.ReadAll() != pinMask)
+    {
+        elapsed = timeslotInfo.GetTicks() - start;
+        if (elapsed >= W1::OneWireDiagnostics::C_RiseTimeTimeoutUs)
+            return W1::OneWireDiagnostics::C_RiseTimeTimeoutUs;
+    }
+    return elapsed;
+}
+
+void W1::OneWireResetSequence::UpdateDiagnostics(uint32_t endLevels)
+{
+    const uint32_t pinMask = this->w1.GetPinMask();
+    W1::OneWireDiagnostics &d = this->diagnostics;
+
+    d.resetCount++;
+    d.lastRiseTimeUs = this->riseTimeUs;
+    if (this->riseTimeUs > d.maxRiseTimeUs)
+    {
+        d.maxRiseTimeUs = this->riseTimeUs;
+    }
+
+    if (this->idleLevels != pinMask)
+    {
+        d.lastFault = W1::OneWireFault::Short;
+        d.shortCount++;
+    }
+    else if (endLevels != pinMask)
+    {
+        d.lastFault = W1::OneWireFault::StuckLow;
+        d.stuckLowCount++;
+    }
+    else if (this->riseTimeUs >= W1::OneWireDiagnostics::C_MaxRiseTimeUs)
+    {
+        d.lastFault = W1::OneWireFault::SlowRise;
+        d.slowRiseCount++;
+    }
+    else if ((this->presenceMask & pinMask) != pinMask)
+    {
+        d.lastFault = W1::OneWireFault::NoPresence;
+        d.noPresenceCount++;
+    }
+    else
+    {
+        d.lastFault = W1::OneWireFault::None;
+    }
 }
 
 TS::DoWorkResult W1::OneWireResetSequence::DoWork(TS::TimeslotInfo timeslotInfo)
@@ -186,6 +293,7 @@ TS::DoWorkResult W1::OneWireResetSequence::DoWork(TS::TimeslotInfo timeslotInfo)
         if (!timeslotInfo.IsEnoughTime(resetLowLength + resetHighLength + safetySpan, res))
             return res;
 
+        this->idleLevels = this->w1.ReadAll();
         this->state = W1::OneWireResetSequenceState::ResetPulse;
         this->w1.PullDown();
         return timeslotInfo.WaitFromNow(resetLowLength);
@@ -193,17 +301,30 @@ TS::DoWorkResult W1::OneWireResetSequence::DoWork(TS::TimeslotInfo timeslotInfo)
     else if (this->state == W1::OneWireResetSequenceState::ResetPulse)
     {
         this->w1.Release();
+        uint32_t riseTimeUs = this->isRiseTimeMeasured ? this->MeasureRiseTime(timeslotInfo) : 0;
+        if (this->isRiseTimeMeasured)
+        {
+            this->riseTimeUs = riseTimeUs;
+        }
         this->state = W1::OneWireResetSequenceState::WaitingForPresencePulse;
-        return timeslotInfo.WaitFromNow(presencePulseDelay);
+        return timeslotInfo.WaitFromNow(presencePulseDelay - riseTimeUs);
     }
     else if (this->state == W1::OneWireResetSequenceState::WaitingForPresencePulse)
     {
-        this->isSlavePresent = !this->w1.Read();
+        this->presenceMask = ~this->w1.ReadAll(); // presence pulse = low level
         this->state = W1::OneWireResetSequenceState::Delay;
         return timeslotInfo.WaitFromNow(resetHighLength - presencePulseDelay);
     }
     else if (this->state == W1::OneWireResetSequenceState::Delay)
     {
+        // lanes low before the reset (short) or held low until its end (stuck low) did not answer, low level during
+        // presence sampling was not a presence pulse
+        uint32_t endLevels = this->w1.ReadAll();
+        this->presenceMask &= this->idleLevels & endLevels;
+        if (this->diagnostics.isEnabled)
+        {
+            this->UpdateDiagnostics(endLevels);
+        }
         this->state = W1::OneWireResetSequenceState::Idle;
         return timeslotInfo.Completed();
     }
@@ -215,7 +336,9 @@ TS::DoWorkResult W1::OneWireResetSequence::DoWork(TS::TimeslotInfo timeslotInfo)
     }
 }
 
-W1::OneWireReadWriteSequence::OneWireReadWriteSequence(W1::OneWirePhysicalLayer &w1) : w1(w1), state(OneWireReadWriteSequenceState::Idle)
+W1::OneWireReadWriteSequence::OneWireReadWriteSequence(W1::OneWirePhysicalLayer &w1, W1::OneWireDiagnostics &diagnostics)
+    : w1(w1), diagnostics(diagnostics), laneCount(0), state(OneWireReadWriteSequenceState::Idle), isStrongPullUpRequested(false),
+      readDelayUs(C_DefaultReadDelayUs), recoveryTimeUs(C_DefaultRecoveryTimeUs)
 {
 }
 
@@ -224,9 +347,39 @@ bool W1::OneWireReadWriteSequence::IsReady()
     return this->state == W1::OneWireReadWriteSequenceState::Idle;
 }
 
-W1::BitBlock &W1::OneWireReadWriteSequence::GetReceivedData()
+W1::BitBlock &W1::OneWireReadWriteSequence::GetReceivedData(uint8_t lane)
+{
+    ASSERT(lane < this->w1.GetLaneCount());
+    return this->readData[lane];
+}
+
+uint8_t W1::OneWireReadWriteSequence::GetReceivedCrc(uint8_t lane)
+{
+    ASSERT(lane < this->w1.GetLaneCount());
+    return this->readCrc[lane];
+}
+
+void W1::OneWireReadWriteSequence::RequestStrongPullUp()
+{
+    this->isStrongPullUpRequested = true;
+}
+
+// Line must be high before sampling a 1 and before the next slot starts, short buses keep the default (tightest) timing
+void W1::OneWireReadWriteSequence::Calibrate(uint32_t riseTimeUs)
+{
+    uint32_t delay = riseTimeUs + C_RiseTimeMarginUs;
+    this->readDelayUs = delay < C_DefaultReadDelayUs ? C_DefaultReadDelayUs : (delay > C_MaxReadDelayUs ? C_MaxReadDelayUs : delay);
+    this->recoveryTimeUs = delay < C_DefaultRecoveryTimeUs ? C_DefaultRecoveryTimeUs : (delay > C_MaxRecoveryTimeUs ? C_MaxRecoveryTimeUs : delay);
+}
+
+uint8_t W1::OneWireReadWriteSequence::GetReadDelayUs()
+{
+    return this->readDelayUs;
+}
+
+uint8_t W1::OneWireReadWriteSequence::GetRecoveryTimeUs()
 {
-    return this->readData;
+    return this->recoveryTimeUs;
 }
 
 uint8_t W1::OneWireReadWriteSequence::GetReadWriteLength()
@@ -235,24 +388,52 @@ uint8_t W1::OneWireReadWriteSequence::GetReadWriteLength()
 }
 
 void W1::OneWireReadWriteSequence::Run(W1::BitBlock &writeData, W1::BitBlock &writeMask, uint8_t length)
+{
+    for (uint8_t lane = 0; lane < this->w1.GetLaneCount(); lane++)
+    {
+        this->writeData[lane] = writeData;
+    }
+    this->Run(this->writeData, writeMask, length);
+}
+
+void W1::OneWireReadWriteSequence::Run(const W1::BitBlock *laneWriteData, W1::BitBlock &writeMask, uint8_t length)
 {
     this->bitIndex = 0;
-    this->writeData = writeData;
+    this->laneCount = this->w1.GetLaneCount();
+    for (uint8_t lane = 0; lane < this->laneCount; lane++)
+    {
+        if (laneWriteData != this->writeData)
+        {
+            this->writeData[lane] = laneWriteData[lane];
+        }
+        this->readData[lane].Clear();
+        this->readCrc[lane] = 0;
+        this->laneMasks[lane] = this->w1.GetLaneMask(lane);
+    }
     this->writeMask = writeMask;
     this->length = length;
-    this->readData.Clear();
     this->state = W1::OneWireReadWriteSequenceState::Working;
 }
 
+void W1::OneWireReadWriteSequence::SetLaneWriteData(uint8_t lane, uint8_t byteIndex, const uint8_t *data, uint8_t length)
+{
+    ASSERT(lane < this->laneCount && byteIndex + length <= W1::BitBlock::C_BytesCount);
+    ASSERT(this->bitIndex == 0);
+    for (uint8_t i = 0; i < length; i++)
+    {
+        this->writeData[lane].Data[byteIndex + i] = data ? data[i] : 0xFF;
+    }
+}
+
 TS::DoWorkResult W1::OneWireReadWriteSequence::DoWork(TS::TimeslotInfo timeslotInfo)
 {
     const uint32_t write0LowTime = 80;
     const uint32_t write1LowTime = 2;
     const uint32_t initReadTime = 2;
-    const uint32_t readDelay = 4;
+    const uint32_t readDelay = this->readDelayUs;
     const uint32_t slotLengthMax = 120;
     const uint32_t slotLengthMin = 60;
-    const uint32_t recoveryTime = 2;
+    const uint32_t recoveryTime = this->recoveryTimeUs;
     const uint32_t safetySpan = 50; 
     TS::DoWorkResult res;
 
@@ -262,36 +443,66 @@ TS::DoWorkResult W1::OneWireReadWriteSequence::DoWork(TS::TimeslotInfo timeslotI
     }
     else if (this->state == W1::OneWireReadWriteSequenceState::Working)
     {
+        // Parameters of each slot are prepared before the slot starts (first one here, others during the tail of previous slot).
+        // Slot phases are timed from the slot start, so only GPIO accesses happen inside the timing windows.
+        const uint32_t pinMask = this->w1.GetPinMask();
+        bool isWrite;
+        uint32_t onesMask;
+        this->PrepareSlot(this->bitIndex, isWrite, onesMask);
+
         while (this->bitIndex < this->length)
         {
             if (!timeslotInfo.IsEnoughTime(write1LowTime + recoveryTime + safetySpan, res))
                 return res;
 
-            if (this->writeMask.IsOne(bitIndex))
+            if (this->diagnostics.isEnabled && this->w1.ReadAll() != pinMask)
             {
-                // write bit
-                bool value = this->writeData.IsOne(bitIndex);
-                this->w1.PullDown();
-                timeslotInfo.SpinDelay(value ? write1LowTime : write0LowTime);
-                this->w1.Release();
-                timeslotInfo.SpinDelay(value ? slotLengthMin : recoveryTime);
+                this->diagnostics.slotLowCount++;
             }
-            else
+
+            uint32_t slotStart = timeslotInfo.GetTicks();
+            uint32_t slotEnd;
+            this->w1.PullDown();
+            if (isWrite && onesMask == pinMask)
             {
-                // read bit
-                this->w1.PullDown();
-                timeslotInfo.SpinDelay(initReadTime);
+                // write 1 on all lanes
+                timeslotInfo.SpinDelayTill(slotStart + write1LowTime);
                 this->w1.Release();
-                timeslotInfo.SpinDelay(readDelay);
-                if (w1.Read())
+                slotEnd = slotStart + write1LowTime + slotLengthMin;
+            }
+            else if (isWrite)
+            {
+                // write 0 (lanes writing 1 are released early)
+                if (onesMask)
                 {
-                    this->readData.SetOne(bitIndex);
+                    timeslotInfo.SpinDelayTill(slotStart + write1LowTime);
+                    this->w1.Release(onesMask);
                 }
-                // else: readData is initialized to zeros at the begining of read/write transaction
-                timeslotInfo.SpinDelay(slotLengthMax - readDelay - initReadTime);
-                timeslotInfo.SpinDelay(recoveryTime);
+                timeslotInfo.SpinDelayTill(slotStart + write0LowTime);
+                this->w1.Release();
+                slotEnd = slotStart + write0LowTime + recoveryTime;
             }
-            bitIndex++;
+            else
+            {
+                // read bit (all lanes sampled by single read of IN register)
+                timeslotInfo.SpinDelayTill(slotStart + initReadTime);
+                this->w1.Release();
+                timeslotInfo.SpinDelayTill(slotStart + initReadTime + readDelay);
+                this->StoreReadSlot(this->bitIndex, this->w1.ReadAll());
+                slotEnd = slotStart + slotLengthMax + recoveryTime;
+            }
+
+            if (++this->bitIndex < this->length)
+            {
+                this->PrepareSlot(this->bitIndex, isWrite, onesMask);
+            }
+            timeslotInfo.SpinDelayTill(slotEnd);
+        }
+
+        if (this->isStrongPullUpRequested)
+        {
+            this->isStrongPullUpRequested = false;
+            this->w1.SetStrongPullUp(true);
         }
 
         this->state = W1::OneWireReadWriteSequenceState::Idle;
@@ -305,26 +516,196 @@ TS::DoWorkResult W1::OneWireReadWriteSequence::DoWork(TS::TimeslotInfo timeslotI
     }
 }
 
-W1::OneWireBus::OneWireBus(uint8_t pinNumber) : state(W1::OneWireBusState::Idle), w1(pinNumber), resetSequence(w1), readWriteSequence(w1)
+// Slot type from write mask, for write slots also pins of lanes writing 1
+void W1::OneWireReadWriteSequence::PrepareSlot(uint8_t index, bool &isWrite, uint32_t &onesMask)
+{
+    uint8_t word = index >> 5;
+    uint32_t bit = 1UL << (index & 31);
+    isWrite = this->writeMask.Words[word] & bit;
+    onesMask = 0;
+    if (isWrite)
+    {
+        for (uint8_t lane = 0; lane < this->laneCount; lane++)
+        {
+            if (this->writeData[lane].Words[word] & bit)
+                onesMask |= this->laneMasks[lane];
+        }
+    }
+}
+
+// readData is initialized to zeros at the begining of read/write transaction, only ones are stored.
+// CRC is updated here (idle part of the slot), so the result is validated as soon as the last bit is received.
+void W1::OneWireReadWriteSequence::StoreReadSlot(uint8_t index, uint32_t levels)
+{
+    uint8_t word = index >> 5;
+    uint32_t bit = 1UL << (index & 31);
+    for (uint8_t lane = 0; lane < this->laneCount; lane++)
+    {
+        bool isOne = levels & this->laneMasks[lane];
+        if (isOne)
+            this->readData[lane].Words[word] |= bit;
+        this->readCrc[lane] = W1::Crc::UpdateBit(this->readCrc[lane], isOne);
+    }
+}
+
+W1::OneWireBus::OneWireBus(uint8_t pinNumber)
+    : state(W1::OneWireBusState::Idle), w1(pinNumber), resetSequence(w1, diagnostics), readWriteSequence(w1, diagnostics), listener(nullptr),
+      queueHead(0), queueCount(0), isTransactionActive(false), activeTag(0)
+{
+    this->diagnostics.isEnabled = false;
+    this->diagnostics.Clear();
+}
+
+W1::OneWireBus::OneWireBus(const uint8_t *pinNumbers, uint8_t laneCount)
+    : state(W1::OneWireBusState::Idle), w1(pinNumbers, laneCount), resetSequence(w1, diagnostics), readWriteSequence(w1, diagnostics), listener(nullptr),
+      queueHead(0), queueCount(0), isTransactionActive(false), activeTag(0)
+{
+    this->diagnostics.isEnabled = false;
+    this->diagnostics.Clear();
+}
+
+void W1::OneWireBus::SetTransactionListener(W1::IOneWireTransactionListener *listener)
+{
+    this->listener = listener;
+}
+
+bool W1::OneWireBus::Enqueue(const W1::OneWireTransaction &transaction)
 {
+    ASSERT(transaction.writeLength <= W1::OneWireTransaction::C_MaxWriteBytes);
+    ASSERT(transaction.writeLength * 8 + transaction.readLength <= W1::BitBlock::C_BitsCount);
+    if (this->queueCount >= C_QueueLength)
+        return false;
+
+    this->queue[(this->queueHead + this->queueCount) % C_QueueLength] = transaction;
+    this->queueCount++;
+    return true;
+}
+
+// Single lane build: the address is written to writeData (all lanes get the same data)
+void W1::OneWireTransaction::SetLaneAddress(uint8_t lane, uint64_t address)
+{
+    ASSERT(lane < W1::OneWirePhysicalLayer::C_MaxLanes);
+    this->laneMask |= 1 << lane;
+    for (uint8_t i = 0; i < 8; i++)
+    {
+#if ONE_WIRE_MAX_LANES > 1
+        this->laneAddresses[lane][i] = (address >> (8 * i)) & 0xFF;
+#else
+        this->writeData[1 + i] = (address >> (8 * i)) & 0xFF;
+#endif
+    }
+}
+
+uint8_t W1::OneWireBus::GetQueueFreeCount()
+{
+    return C_QueueLength - this->queueCount;
+}
+
+// Starts the oldest queued transaction, the queue slot is released immediately (listener may enqueue from callback)
+bool W1::OneWireBus::StartNextTransaction()
+{
+    if (this->queueCount == 0)
+        return false;
+
+    const W1::OneWireTransaction & transaction = this->queue[this->queueHead];
+    W1::BitBlock writeData;
+    W1::BitBlock writeMask;
+    for (uint8_t i = 0; i < transaction.writeLength; i++)
+    {
+        writeData.Data[i] = transaction.writeData[i];
+        writeMask.Data[i] = 0xFF;
+    }
+    uint8_t length = transaction.writeLength * 8 + transaction.readLength;
+    if (length)
+    {
+        this->ReadWrite(transaction.reset, writeData, writeMask, length);
+        if (transaction.laneMask)
+        {
+            ASSERT(transaction.writeLength >= 9 && transaction.writeData[0] == W1::RomCommand::MatchRom);
+            for (uint8_t lane = 0; lane < this->w1.GetLaneCount(); lane++)
+            {
+                if (!(transaction.laneMask & (1 << lane)))
+                {
+                    this->readWriteSequence.SetLaneWriteData(lane, 0, nullptr, transaction.writeLength);
+                }
+#if ONE_WIRE_MAX_LANES > 1
+                else
+                {
+                    this->readWriteSequence.SetLaneWriteData(lane, 1, transaction.laneAddresses[lane], 8);
+                }
+#endif
+            }
+        }
+    }
+    else
+    {
+        this->Reset();
+    }
+
+    this->activeTag = transaction.tag;
+    this->isTransactionActive = true;
+    this->queueHead = (this->queueHead + 1) % C_QueueLength;
+    this->queueCount--;
+    return true;
+}
+
+void W1::OneWireBus::RequestStrongPullUp()
+{
+    ASSERT(this->state == W1::OneWireBusState::Idle);
+    this->readWriteSequence.RequestStrongPullUp();
+}
+
+void W1::OneWireBus::EndStrongPullUp()
+{
+    this->w1.SetStrongPullUp(false);
 }
 
 void W1::OneWireBus::Reset()
 {
     ASSERT(this->state == W1::OneWireBusState::Idle);
+    ASSERT(!this->w1.IsStrongPullUp());
     this->state = W1::OneWireBusState::Reset;
     this->resetSequence.Run();
 }
 
+void W1::OneWireBus::Calibrate()
+{
+    ASSERT(this->state == W1::OneWireBusState::Idle);
+    ASSERT(!this->w1.IsStrongPullUp());
+    this->state = W1::OneWireBusState::Calibrate;
+    this->resetSequence.Run(true);
+}
+
+uint8_t W1::OneWireBus::GetReadDelayUs()
+{
+    return this->readWriteSequence.GetReadDelayUs();
+}
+
+uint8_t W1::OneWireBus::GetRecoveryTimeUs()
+{
+    return this->readWriteSequence.GetRecoveryTimeUs();
+}
+
 void W1::OneWireBus::ReadWrite(bool reset, W1::BitBlock &writeData, W1::BitBlock &writeMask, uint8_t length)
 {
     ASSERT(this->state == W1::OneWireBusState::Idle);
+    ASSERT(!this->w1.IsStrongPullUp());
     this->state = reset ? W1::OneWireBusState::ResetAndReadWrite : W1::OneWireBusState::ReadWrite;
     if(reset)
         this->resetSequence.Run();
     this->readWriteSequence.Run(writeData, writeMask, length);
 }
 
+void W1::OneWireBus::ReadWrite(bool reset, const W1::BitBlock *laneWriteData, W1::BitBlock &writeMask, uint8_t length)
+{
+    ASSERT(this->state == W1::OneWireBusState::Idle);
+    ASSERT(!this->w1.IsStrongPullUp());
+    this->state = reset ? W1::OneWireBusState::ResetAndReadWrite : W1::OneWireBusState::ReadWrite;
+    if(reset)
+        this->resetSequence.Run();
+    this->readWriteSequence.Run(laneWriteData, writeMask, length);
+}
+
 void W1::OneWireBus::ReadWrite(bool reset, uint16_t writeData, uint16_t writeMask, uint8_t length)
 {
     ASSERT(this->state == W1::OneWireBusState::Idle);
@@ -349,14 +730,39 @@ bool W1::OneWireBus::IsReady()
     return this->state == W1::OneWireBusState::Idle;
 }
 
-bool W1::OneWireBus::IsSlavePresent()
+bool W1::OneWireBus::IsSlavePresent(uint8_t lane)
+{
+    return this->resetSequence.IsSlavePresent(lane);
+}
+
+W1::BitBlock &W1::OneWireBus::GetReceivedData(uint8_t lane)
+{
+    return this->readWriteSequence.GetReceivedData(lane);
+}
+
+uint8_t W1::OneWireBus::GetReceivedCrc(uint8_t lane)
 {
-    return this->resetSequence.IsSlavePresent();
+    return this->readWriteSequence.GetReceivedCrc(lane);
 }
 
-W1::BitBlock &W1::OneWireBus::GetReceivedData()
+uint8_t W1::OneWireBus::GetLaneCount()
 {
-    return this->readWriteSequence.GetReceivedData();
+    return this->w1.GetLaneCount();
+}
+
+void W1::OneWireBus::SetDiagnosticsEnabled(bool enable)
+{
+    this->diagnostics.isEnabled = enable;
+}
+
+const W1::OneWireDiagnostics & W1::OneWireBus::GetDiagnostics()
+{
+    return this->diagnostics;
+}
+
+void W1::OneWireBus::ClearDiagnostics()
+{
+    this->diagnostics.Clear();
 }
 
 uint8_t W1::OneWireBus::GetReadWriteLength()
@@ -368,13 +774,17 @@ TS::DoWorkResult W1::OneWireBus::DoWork(TS::TimeslotInfo timeslotInfo)
 {
     while (true)
     {
+        TS::DoWorkResult res;
         if (this->state == W1::OneWireBusState::Idle)
         {
+            if (this->StartNextTransaction())
+                continue;
             return timeslotInfo.Completed();
         }
-        else if (this->state == W1::OneWireBusState::Reset || this->state == W1::OneWireBusState::ResetAndReadWrite)
+        else if (this->state == W1::OneWireBusState::Reset || this->state == W1::OneWireBusState::ResetAndReadWrite ||
+                 this->state == W1::OneWireBusState::Calibrate)
         {
-            TS::DoWorkResult res = this->resetSequence.DoWork(timeslotInfo);
+            res = this->resetSequence.DoWork(timeslotInfo);
             if (res.type == TS::DoWorkResultType::Completed)
             {
                 if (this->state == W1::OneWireBusState::ResetAndReadWrite)
@@ -382,37 +792,58 @@ TS::DoWorkResult W1::OneWireBus::DoWork(TS::TimeslotInfo timeslotInfo)
                     this->state = W1::OneWireBusState::ReadWrite;
                     continue;
                 }
+                else if (this->state == W1::OneWireBusState::Calibrate)
+                {
+                    this->readWriteSequence.Calibrate(this->resetSequence.GetRiseTimeUs());
+                    this->state = W1::OneWireBusState::Idle;
+                }
                 else
                 {
                     this->state = W1::OneWireBusState::Idle;
                 }
             }
-            return res;
         }
         else if (this->state == W1::OneWireBusState::ReadWrite)
         {
-            TS::DoWorkResult res = this->readWriteSequence.DoWork(timeslotInfo);
+            res = this->readWriteSequence.DoWork(timeslotInfo);
             if (res.type == TS::DoWorkResultType::Completed)
             {
                 this->state = W1::OneWireBusState::Idle;
             }
-            return res;
         }
         else
         {
             ASSERT(false);
             return timeslotInfo.Completed();
         }
+
+        if (res.type == TS::DoWorkResultType::Completed && this->isTransactionActive)
+        {
+            // queued transaction done, continue with the next one without leaving the timeslot
+            this->isTransactionActive = false;
+            if (this->listener)
+            {
+                this->listener->OnTransactionCompleted(this->activeTag);
+            }
+            continue;
+        }
+        return res;
     }
 }
 
-W1::SearchRomHelper::SearchRomHelper(OneWireBus &bus) : bus(bus), state(W1::SearchRomHelperState::Idle), deviceCount(0)
+W1::SearchRomHelper::SearchRomHelper(OneWireBus &bus, ISearchRomListener &listener) : bus(bus), listener(listener), state(W1::SearchRomHelperState::Idle), deviceCount(0), isSearchComplete(false), pauseAfterDeviceUs(0), command(W1::RomCommand::SearchRom), lane(0)
 {
 }
 
-void W1::SearchRomHelper::Run()
+void W1::SearchRomHelper::Run(uint32_t pauseAfterDeviceUs, uint8_t command, uint8_t lane)
 {
     ASSERT(this->bus.IsReady());
+    ASSERT(lane < this->bus.GetLaneCount());
+
+    this->pauseAfterDeviceUs = pauseAfterDeviceUs;
+    this->command = command;
+    this->lane = lane;
+    this->isSearchComplete = false;
 
     this->bitIndex = 0;
     this->state = W1::SearchRomHelperState::ResetCmd;
@@ -438,20 +869,20 @@ TS::DoWorkResult W1::SearchRomHelper::DoWork(TS::TimeslotInfo timeslotInfo)
         {
             if (this->state == W1::SearchRomHelperState::ResetCmd)
             {
-                if (bus.IsSlavePresent())
+                if (bus.IsSlavePresent(this->lane))
                 {
-                    bus.ReadWrite(false, W1::RomCommand::SearchRom, 0xFF, 10); //write command (8 bits), read address bit (bit + complement, 2 bits)
+                    bus.ReadWrite(false, this->command, 0xFF, 10); //write command (8 bits), read address bit (bit + complement, 2 bits)
                     this->state = W1::SearchRomHelperState::Search;
                 }
                 else
                 {
-                    this->deviceCount = 0;
+                    this->isSearchComplete = this->deviceCount == 0; // no device at all vs. device disconnected during search
                     this->state = W1::SearchRomHelperState::Idle;
                 }
             }
             else if (this->state == W1::SearchRomHelperState::Search)
             {
-                W1::BitBlock receivedData = bus.GetReceivedData();
+                W1::BitBlock & receivedData = bus.GetReceivedData(this->lane);
                 bool bit1 = receivedData.IsOne(bus.GetReadWriteLength() - 2);
                 bool bit2 = receivedData.IsOne(bus.GetReadWriteLength() - 1);
 
@@ -465,8 +896,10 @@ TS::DoWorkResult W1::SearchRomHelper::DoWork(TS::TimeslotInfo timeslotInfo)
                 }
                 else if (bit1 && bit2)
                 {
-                    // no response => no slave device
+                    // no response => no slave device (e.g. no device in alarm state), aborted search if some device was already found
+                    this->isSearchComplete = this->bitIndex == 0 && this->deviceCount == 0;
                     this->state = W1::SearchRomHelperState::Idle;
+                    return timeslotInfo.Completed();
                 }
                 else
                 {
@@ -491,18 +924,27 @@ TS::DoWorkResult W1::SearchRomHelper::DoWork(TS::TimeslotInfo timeslotInfo)
                 if (this->bitIndex == 63)
                 {
                     this->bitIndex = 0;
-                    bool crcError = W1::Crc::Compute(this->currentAddress, 0, 7) != this->currentAddress.Data[7];
-                    if (this->deviceCount < C_maxDeviceCount && !crcError)
-                        this->devices[this->deviceCount++] = this->currentAddress.ToUInt64(0);
+                    bool crcError = W1::Crc::Compute(this->currentAddress.Data, 7) != this->currentAddress.Data[7];
+                    if (!crcError)
+                    {
+                        this->deviceCount++;
+                        this->listener.OnDeviceFound(this->currentAddress.ToUInt64(0));
+                    }
                     this->lastDiscrepancy = this->lastZero;
                     if (this->lastZero == C_UnsetIndex || crcError)
                     {
+                        this->isSearchComplete = !crcError;
                         this->state = W1::SearchRomHelperState::Idle;
                     }
                     else
                     {
                         bus.Reset();
                         this->state = W1::SearchRomHelperState::ResetCmd;
+                        if (this->pauseAfterDeviceUs)
+                        {
+                            this->lastZero = C_UnsetIndex;
+                            return timeslotInfo.WaitForLongTime(this->pauseAfterDeviceUs, 0);
+                        }
                     }
                     this->lastZero = C_UnsetIndex;
                 }
@@ -530,13 +972,14 @@ bool W1::SearchRomHelper::IsReady()
     return this->state == W1::SearchRomHelperState::Idle;
 }
 
-uint8_t W1::SearchRomHelper::GetDeviceCount()
+bool W1::SearchRomHelper::IsSearchComplete()
 {
-    return this->deviceCount;
+    return this->isSearchComplete;
 }
 
-uint64_t W1::SearchRomHelper::GetDeviceAddress(uint8_t index)
+uint8_t W1::SearchRomHelper::GetDeviceCount()
 {
-    return this->devices[index];
+    return this->deviceCount;
 }
 
+
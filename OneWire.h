@@ -2,18 +2,26 @@
 #define TIMESLOTMANAGER_H_749ac65c9f6f
 
 #include "TimeslotManager.h"
+#include "Crc.h"
 
 namespace W1
 {
+    // Bits are stored in 32-bit words (bit i = bit i % 32 of word i / 32), byte access through Data (little endian)
     class BitBlock
     {
         public:
-            static const uint8_t C_BytesCount = 12;
+            static const uint8_t C_BytesCount = 20; // MatchRom + command (80 bits) followed by whole scratchpad (72 bits)
             static const uint8_t C_BitsCount = C_BytesCount * 8;
+            static const uint8_t C_WordsCount = C_BytesCount / 4;
+            static_assert(C_BytesCount % 4 == 0, "BitBlock size must be multiple of word size");
 
             BitBlock();
             BitBlock(uint8_t value);
-            uint8_t Data[C_BytesCount];
+            union
+            {
+                uint8_t Data[C_BytesCount];
+                uint32_t Words[C_WordsCount];
+            };
             void Set(uint8_t index, bool value);
             void SetOne(uint8_t index);
             void SetZero(uint8_t index);
@@ -25,26 +33,64 @@ namespace W1
             void FromUInt64(uint64_t value, uint8_t byteIndex);
     };
 
-    class Crc
-    {
-    public:
-        static uint8_t Compute(uint8_t * data, uint16_t length);
-        static uint8_t Compute(BitBlock & data, uint8_t firstByte, uint8_t length);
-        static const uint8_t lookupTable[];
-    };
-
+    // Drives one or more 1-wire lanes (pins on the same GPIO port), all lanes are switched by a single OUTSET/OUTCLR write
     class OneWirePhysicalLayer
     {
         public:
             static const bool C_driveDebugPin = true;
             static const uint8_t C_debugPinNumber = 3;
+            static const uint8_t C_MaxLanes = ONE_WIRE_MAX_LANES;
+            static_assert(C_MaxLanes > 0 && C_MaxLanes <= 8, "ONE_WIRE_MAX_LANES out of range");
 
             OneWirePhysicalLayer(uint8_t pinNumber);
+            OneWirePhysicalLayer(const uint8_t * pinNumbers, uint8_t laneCount);
             void PullDown();
             void Release();
-            bool Read(); //true = high, false = low
+            void Release(uint32_t pinMask); // releases only given pins (others stay pulled down)
+            bool Read(); //true = high, false = low (lane 0)
+            uint32_t ReadAll(); // levels of all lanes (GPIO IN register masked by lane pins)
+            uint32_t GetLaneMask(uint8_t lane);
+            uint32_t GetPinMask(); // all lanes
+            uint8_t GetLaneCount();
+            void SetStrongPullUp(bool enable); // enable = pins drive high level actively (push-pull), powers parasite devices
+            bool IsStrongPullUp();
         private:
-            uint8_t pinNumber;
+            void Configure();
+
+            uint32_t pinMask;
+            uint32_t laneMasks[C_MaxLanes];
+            uint8_t pinNumbers[C_MaxLanes];
+            uint8_t laneCount;
+            bool isStrongPullUp;
+    };
+
+    enum class OneWireFault
+    {
+        None,
+        Short,     // line low before reset pulse (short to ground, missing pull-up)
+        StuckLow,  // line still low at the end of reset (short during reset, device holding the line)
+        SlowRise,  // line not high within C_MaxRiseTimeUs after release (long cable, weak pull-up)
+        NoPresence // healthy line without presence pulse (open cable, no device)
+    };
+
+    // Bus health counters, each reset classifies the worst fault seen on any lane
+    struct OneWireDiagnostics
+    {
+        static const uint32_t C_MaxRiseTimeUs = 10; // slaves answer >= 15 us after the rising edge, sampling ends before
+        static const uint32_t C_RiseTimeTimeoutUs = 30; // measurement limit, slower buses still get calibrated recovery time
+
+        bool isEnabled;
+        OneWireFault lastFault;
+        uint8_t lastRiseTimeUs; // after last reset pulse (slowest lane), C_RiseTimeTimeoutUs = line did not rise in time
+        uint8_t maxRiseTimeUs;
+        uint32_t resetCount;
+        uint32_t shortCount;
+        uint32_t stuckLowCount;
+        uint32_t slowRiseCount;
+        uint32_t noPresenceCount;
+        uint32_t slotLowCount; // line low at the start of a read/write slot (recovery time too short for the bus)
+
+        void Clear(); // counters only, isEnabled is kept
     };
 
     enum class OneWireResetSequenceState
@@ -59,15 +105,23 @@ namespace W1
     class OneWireResetSequence
     {
         public:
-            OneWireResetSequence(W1::OneWirePhysicalLayer & w1);
+            OneWireResetSequence(W1::OneWirePhysicalLayer & w1, OneWireDiagnostics & diagnostics);
             bool IsReady();
-            void Run();
+            void Run(bool measureRiseTime = false); // rise time is always measured in diagnostics mode
             TS::DoWorkResult DoWork(TS::TimeslotInfo timeslotInfo);
-            bool IsSlavePresent();
+            bool IsSlavePresent(uint8_t lane = 0);
+            uint32_t GetRiseTimeUs(); // of the last reset with measurement
         private:
+            uint32_t MeasureRiseTime(TS::TimeslotInfo & timeslotInfo);
+            void UpdateDiagnostics(uint32_t endLevels);
+
             OneWireResetSequenceState state;
             OneWirePhysicalLayer & w1;
-            bool isSlavePresent;
+            OneWireDiagnostics & diagnostics;
+            uint32_t presenceMask; // lanes with presence pulse (pin mask)
+            uint32_t idleLevels;   // line levels before reset pulse
+            uint32_t riseTimeUs;
+            bool isRiseTimeMeasured;
     };
 
     enum class OneWireReadWriteSequenceState
@@ -79,20 +133,71 @@ namespace W1
     class OneWireReadWriteSequence
     {
         public:
-            OneWireReadWriteSequence(OneWirePhysicalLayer & w1);
+            OneWireReadWriteSequence(OneWirePhysicalLayer & w1, OneWireDiagnostics & diagnostics);
             bool IsReady();
-            void Run(BitBlock & writeData, BitBlock & writeMask, uint8_t length);
+            void Run(BitBlock & writeData, BitBlock & writeMask, uint8_t length); // same data written to all lanes
+            void Run(const BitBlock * laneWriteData, BitBlock & writeMask, uint8_t length); // laneWriteData[lane], writeMask is shared
+            void SetLaneWriteData(uint8_t lane, uint8_t byteIndex, const uint8_t * data, uint8_t length); // after Run, data = nullptr => all ones
             TS::DoWorkResult DoWork(TS::TimeslotInfo timeslotInfo);
-            BitBlock & GetReceivedData();
+            BitBlock & GetReceivedData(uint8_t lane = 0);
+            uint8_t GetReceivedCrc(uint8_t lane = 0);
             uint8_t GetReadWriteLength();
+            void RequestStrongPullUp(); // strong pull-up is enabled right after the last bit of the next transfer
+            void Calibrate(uint32_t riseTimeUs); // adapts read sample point and recovery time to the bus rise time
+            uint8_t GetReadDelayUs();
+            uint8_t GetRecoveryTimeUs();
+
+            static const uint8_t C_DefaultReadDelayUs = 4;
+            static const uint8_t C_DefaultRecoveryTimeUs = 2;
+            static const uint8_t C_RiseTimeMarginUs = 2;
+            static const uint8_t C_MaxReadDelayUs = 11; // sample at 13 us at the latest (slave keeps 0 for at least 15 us)
+            static const uint8_t C_MaxRecoveryTimeUs = 20;
         private:
+            void PrepareSlot(uint8_t index, bool & isWrite, uint32_t & onesMask);
+            void StoreReadSlot(uint8_t index, uint32_t levels);
+
             OneWirePhysicalLayer & w1;
+            OneWireDiagnostics & diagnostics;
+            uint32_t laneMasks[OneWirePhysicalLayer::C_MaxLanes]; // copy of w1 lane masks (no calls in the bit loop)
+            uint8_t laneCount;
             OneWireReadWriteSequenceState state;
             uint8_t bitIndex;
-            BitBlock writeData;
+            BitBlock writeData[OneWirePhysicalLayer::C_MaxLanes];
             BitBlock writeMask;
-            BitBlock readData;
+            BitBlock readData[OneWirePhysicalLayer::C_MaxLanes];
+            uint8_t readCrc[OneWirePhysicalLayer::C_MaxLanes]; // CRC-8 of read bits accumulated during reception
             uint8_t length;
+            bool isStrongPullUpRequested;
+            uint8_t readDelayUs;    // from release to sampling in read slot
+            uint8_t recoveryTimeUs; // high level between slots
+    };
+
+    // Queued bus transaction: optional reset, 'writeLength' bytes written, then 'readLength' bits read
+    struct OneWireTransaction
+    {
+        static const uint8_t C_MaxWriteBytes = 13; // MatchRom, address, command and 3 data bytes
+
+        uint8_t writeData[C_MaxWriteBytes];
+        uint8_t writeLength; // [bytes]
+        uint8_t readLength;  // [bits]
+        bool reset;
+        // lockstep Match ROM on multi-lane bus: lanes in the mask get their own ROM code in writeData[1:8], other lanes
+        // get all ones (no device is selected), 0 = writeData is written to all lanes
+        uint8_t laneMask;
+        uint16_t tag;        // passed to listener
+#if ONE_WIRE_MAX_LANES > 1
+        uint8_t laneAddresses[ONE_WIRE_MAX_LANES][8];
+#endif
+
+        void SetLaneAddress(uint8_t lane, uint64_t address);
+    };
+
+    class IOneWireTransactionListener
+    {
+        public:
+            // called from bus DoWork when a queued transaction is done, results are available through bus getters
+            // (GetReceivedData, GetReceivedCrc, IsSlavePresent) and new transactions may be enqueued
+            virtual void OnTransactionCompleted(uint16_t tag) = 0;
     };
 
     enum class OneWireBusState
@@ -100,30 +205,81 @@ namespace W1
         Idle,
         Reset,
         ReadWrite,
-        ResetAndReadWrite
+        ResetAndReadWrite,
+        Calibrate
     };
 
     class OneWireBus
     {
         public:
             OneWireBus(uint8_t pinNumber);
+            OneWireBus(const uint8_t * pinNumbers, uint8_t laneCount); // parallel buses driven in lockstep
             TS::DoWorkResult DoWork(TS::TimeslotInfo timeslotInfo);
 
             void Reset();
+            // reset with rise time measurement, read slot sampling and recovery time are set accordingly (call at startup,
+            // no devices are addressed)
+            void Calibrate();
+            uint8_t GetReadDelayUs();
+            uint8_t GetRecoveryTimeUs();
             void ReadWrite(bool reset, BitBlock & writeData, BitBlock & writeMask, uint8_t length);
+            void ReadWrite(bool reset, const BitBlock * laneWriteData, BitBlock & writeMask, uint8_t length);
             void ReadWrite(bool reset, uint16_t writeData, uint16_t  writeMask, uint8_t length);
             void Read(bool reset, uint8_t length);
+            // queued transactions are executed back-to-back (in the same timeslot while there is enough time),
+            // direct ReadWrite/Reset calls must not be mixed with a non-empty queue
+            void SetTransactionListener(IOneWireTransactionListener * listener);
+            bool Enqueue(const OneWireTransaction & transaction); // false = queue is full
+            uint8_t GetQueueFreeCount();
+            // Parasite power: next ReadWrite (e.g. Convert T, Copy Scratchpad) switches the bus to strong pull-up
+            // right after its last bit (within 10 us), it is held until EndStrongPullUp (no bus activity meanwhile)
+            void RequestStrongPullUp();
+            void EndStrongPullUp();
+            // diagnostics mode: line is sampled before, during and after reset and at the start of each slot
+            void SetDiagnosticsEnabled(bool enable);
+            const OneWireDiagnostics & GetDiagnostics();
+            void ClearDiagnostics();
 
             bool IsReady();
             void Disable();
-            bool IsSlavePresent();
-            BitBlock & GetReceivedData();
+            bool IsSlavePresent(uint8_t lane = 0);
+            BitBlock & GetReceivedData(uint8_t lane = 0);
+            // CRC-8 of all read bits of the last transfer, 0 = received bytes followed by their CRC byte are valid
+            uint8_t GetReceivedCrc(uint8_t lane = 0);
             uint8_t GetReadWriteLength();
+            uint8_t GetLaneCount();
+            static const uint8_t C_QueueLength = ONE_WIRE_TRANSACTION_QUEUE_LENGTH;
+
         private:
+            bool StartNextTransaction();
+
             OneWireBusState state;
             OneWirePhysicalLayer w1;
+            OneWireDiagnostics diagnostics;
             OneWireResetSequence resetSequence;
             OneWireReadWriteSequence readWriteSequence;
+            IOneWireTransactionListener * listener;
+            OneWireTransaction queue[C_QueueLength];
+            uint8_t queueHead;
+            uint8_t queueCount;
+            bool isTransactionActive;
+            uint16_t activeTag;
+    };
+
+    class RomCommand
+    {
+    public:
+        static const uint8_t SearchRom = 0xF0;
+        static const uint8_t ReadRom = 0x33;
+        static const uint8_t MatchRom = 0x55;
+        static const uint8_t SkipRom = 0xCC;
+        static const uint8_t AlarmSearch = 0xEC;
+    };
+
+    class ISearchRomListener
+    {
+        public:
+            virtual void OnDeviceFound(uint64_t address) = 0; // called from timeslot for each found device (CRC is checked)
     };
 
     enum class SearchRomHelperState
@@ -136,37 +292,35 @@ namespace W1
     class SearchRomHelper
     {
         public:
-            static const uint8_t C_maxDeviceCount = 8; // maximal number of 1-wire devices
+            static const uint8_t C_maxDeviceCount = ONE_WIRE_MAX_DEVICE_COUNT; // maximal number of 1-wire devices
+            static_assert(C_maxDeviceCount > 0 && C_maxDeviceCount <= 250, "ONE_WIRE_MAX_DEVICE_COUNT out of range");
 
-            SearchRomHelper(OneWireBus & bus);
-            void Run();
+            SearchRomHelper(OneWireBus & bus, ISearchRomListener & listener);
+            // pauseAfterDeviceUs > 0 => timeslot is ended after each found device (background search)
+            // command = AlarmSearch => only devices with alarm flag set are found
+            // lane = searched lane of multi-lane bus (devices on other lanes drop out after the first mismatching bit)
+            void Run(uint32_t pauseAfterDeviceUs = 0, uint8_t command = RomCommand::SearchRom, uint8_t lane = 0);
             TS::DoWorkResult DoWork(TS::TimeslotInfo timeslotInfo);
             bool IsReady();
-            uint8_t GetDeviceCount();
-            uint64_t GetDeviceAddress(uint8_t index);            
+            bool IsSearchComplete(); // false if the search was aborted (CRC error, device disconnected during search)
+            uint8_t GetDeviceCount(); // number of devices reported to listener by the last search
 
         private:
             static const uint8_t C_UnsetIndex = 255;
 
-            OneWireBus bus;
+            OneWireBus & bus;
+            ISearchRomListener & listener;
             SearchRomHelperState state;
             uint8_t deviceCount;
-            uint64_t devices[C_maxDeviceCount];
+            bool isSearchComplete;
+            uint32_t pauseAfterDeviceUs;
+            uint8_t command;
+            uint8_t lane;
 
             uint8_t bitIndex;
             BitBlock currentAddress;
             uint8_t lastDiscrepancy;
             uint8_t lastZero;
     };
-
-    class RomCommand
-    {
-    public:
-        static const uint8_t SearchRom = 0xF0;
-        static const uint8_t ReadRom = 0x33;
-        static const uint8_t MatchRom = 0x55;
-        static const uint8_t SkipRom = 0xCC;
-        static const uint8_t AlarmSearch = 0xEC;
-    };
 }
 #endif
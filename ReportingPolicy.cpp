@@ -0,0 +1,52 @@
+#include "ReportingPolicy.h"
+
+extern "C"
+{
+#include "nrf_assert.h"
+}
+
+ReportingPolicy::ReportingPolicy(uint16_t maxSilentCycles) : maxSilentCycles(maxSilentCycles), silentCycles(0), isReported(false)
+{
+    for (uint8_t i = 0; i < C_MaxChannels; i++)
+    {
+        this->values[i] = 0;
+        this->reportedValues[i] = 0;
+        this->deadbands[i] = 0;
+    }
+}
+
+void ReportingPolicy::SetDeadband(uint8_t channel, int32_t deadband)
+{
+    ASSERT(channel < C_MaxChannels);
+    this->deadbands[channel] = deadband;
+}
+
+void ReportingPolicy::Update(uint8_t channel, int32_t value)
+{
+    ASSERT(channel < C_MaxChannels);
+    this->values[channel] = value;
+}
+
+bool ReportingPolicy::IsReportDue()
+{
+    if (!this->isReported || ++this->silentCycles >= this->maxSilentCycles)
+        return true;
+
+    for (uint8_t i = 0; i < C_MaxChannels; i++)
+    {
+        int32_t change = this->values[i] - this->reportedValues[i];
+        if (change > this->deadbands[i] || change < -this->deadbands[i])
+            return true;
+    }
+    return false;
+}
+
+void ReportingPolicy::Reported()
+{
+    for (uint8_t i = 0; i < C_MaxChannels; i++)
+    {
+        this->reportedValues[i] = this->values[i];
+    }
+    this->silentCycles = 0;
+    this->isReported = true;
+}
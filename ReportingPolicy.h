@@ -0,0 +1,28 @@
+#ifndef REPORTINGPOLICY_H_5a9d3e07b2c4
+#define REPORTINGPOLICY_H_5a9d3e07b2c4
+
+#include <cstdint>
+
+// Decides when the advertised values have to be refreshed: a value moved by more than the deadband of its channel
+// since the last report, or nothing was reported for maxSilentCycles measurements (heartbeat)
+class ReportingPolicy
+{
+public:
+    static const uint8_t C_MaxChannels = 4;
+
+    ReportingPolicy(uint16_t maxSilentCycles);
+    void SetDeadband(uint8_t channel, int32_t deadband); // change <= deadband is not reported, 0 = any change
+    void Update(uint8_t channel, int32_t value);         // current value of the channel
+    bool IsReportDue();                                  // call once per measurement cycle after all Updates
+    void Reported();                                     // current values were advertised
+
+private:
+    int32_t values[C_MaxChannels];
+    int32_t reportedValues[C_MaxChannels];
+    int32_t deadbands[C_MaxChannels];
+    uint16_t maxSilentCycles;
+    uint16_t silentCycles;
+    bool isReported; // at least one report was done (first cycle is always reported)
+};
+
+#endif
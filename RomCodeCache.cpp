@@ -0,0 +1,169 @@
+#include "RomCodeCache.h"
+
+extern "C"
+{
+    #include "nrf.h"
+    #include "nrf_assert.h"
+    #include "nrf_log.h"
+}
+
+FS_REGISTER_CFG(fs_config_t romCodeCacheFsConfig) =
+{
+    W1::RomCodeCache::FsEventHandlerStatic, // callback
+    1,                                      // num_pages
+    0xFE,                                   // priority
+    nullptr,                                // p_start_addr (assigned by fs_init)
+    nullptr                                 // p_end_addr (assigned by fs_init)
+};
+
+W1::RomCodeCache::RomCodeCache() : state(W1::RomCodeCacheState::Idle), isModified(false), pendingCount(0)
+{
+}
+
+uint8_t W1::RomCodeCache::Load(uint64_t * devices, uint8_t maxCount)
+{
+    const uint32_t * page = romCodeCacheFsConfig.p_start_addr;
+    if (page == nullptr || page[0] != C_Magic || page[1] > maxCount || page[1] > SearchRomHelper::C_maxDeviceCount)
+        return 0;
+
+    uint8_t count = page[1];
+    for (uint8_t i = 0; i < count; i++)
+    {
+        W1::BitBlock address;
+        address.FromUInt64(page[C_HeaderLengthWords + 2 * i] | (static_cast<uint64_t>(page[C_HeaderLengthWords + 2 * i + 1]) << 32), 0);
+        if (W1::Crc::Compute(address.Data, 7) != address.Data[7])
+        {
+            // erased or corrupted page
+            return 0;
+        }
+        devices[i] = address.ToUInt64(0);
+    }
+    return count;
+}
+
+bool W1::RomCodeCache::IsStored(const uint64_t * devices, uint8_t count)
+{
+    const uint32_t * page = romCodeCacheFsConfig.p_start_addr;
+    if (page == nullptr || page[0] != C_Magic || page[1] != count)
+        return false;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (page[C_HeaderLengthWords + 2 * i] != (devices[i] & 0xFFFFFFFF) || page[C_HeaderLengthWords + 2 * i + 1] != (devices[i] >> 32))
+            return false;
+    }
+    return true;
+}
+
+void W1::RomCodeCache::Store(const uint64_t * devices, uint8_t count)
+{
+    ASSERT(count <= SearchRomHelper::C_maxDeviceCount);
+    if (this->state == W1::RomCodeCacheState::Idle && this->IsStored(devices, count))
+        return;
+
+    // the driver's list is changed by the timeslot later (sensors removed, search repeated)
+    for (uint8_t i = 0; i < count; i++)
+    {
+        this->pendingDevices[i] = devices[i];
+    }
+    this->pendingCount = count;
+    __DMB();
+    this->isModified = true;
+    if (this->state == W1::RomCodeCacheState::Idle)
+    {
+        this->state = W1::RomCodeCacheState::Erase;
+    }
+}
+
+void W1::RomCodeCache::DoWork()
+{
+    this->StartOperation();
+}
+
+// Queues the next flash operation of the write, it is retried by DoWork if the fstorage queue is full.
+// The page is erased first, so the header (written last) marks complete content.
+void W1::RomCodeCache::StartOperation()
+{
+    fs_ret_t res = FS_SUCCESS;
+    const uint32_t * page = romCodeCacheFsConfig.p_start_addr;
+    W1::RomCodeCacheState startedState = this->state;
+    switch (startedState)
+    {
+    case W1::RomCodeCacheState::Erase:
+        // copy is repeated if Store (timeslot) interrupted it
+        do
+        {
+            this->isModified = false;
+            __DMB();
+            for (uint8_t i = 0; i < this->pendingCount; i++)
+            {
+                this->devices[i] = this->pendingDevices[i];
+            }
+            this->header[1] = this->pendingCount;
+            __DMB();
+        } while (this->isModified);
+        this->header[0] = C_Magic;
+        this->state = W1::RomCodeCacheState::Erasing;
+        res = fs_erase(&romCodeCacheFsConfig, page, 1, this);
+        break;
+    case W1::RomCodeCacheState::StoreAddresses:
+        // uint64_t array has the same layout as the page (lower word first on little endian CPU)
+        this->state = W1::RomCodeCacheState::StoringAddresses;
+        res = fs_store(&romCodeCacheFsConfig, page + C_HeaderLengthWords, reinterpret_cast<const uint32_t *>(this->devices), 2 * this->header[1], this);
+        break;
+    case W1::RomCodeCacheState::StoreHeader:
+        this->state = W1::RomCodeCacheState::StoringHeader;
+        res = fs_store(&romCodeCacheFsConfig, page, this->header, C_HeaderLengthWords, this);
+        break;
+    default:
+        return;
+    }
+
+    if (res != FS_SUCCESS)
+    {
+        // fstorage queue is full (other module), try again later
+        this->state = startedState;
+        NRF_LOG_WARNING("ROM code cache: flash operation not queued (%d)\r\n", res);
+    }
+}
+
+bool W1::RomCodeCache::IsBusy()
+{
+    return this->state != W1::RomCodeCacheState::Idle;
+}
+
+void W1::RomCodeCache::FsEventHandlerStatic(fs_evt_t const * const evt, fs_ret_t result)
+{
+    static_cast<W1::RomCodeCache *>(evt->p_context)->FsEventHandler(evt, result);
+}
+
+void W1::RomCodeCache::FsEventHandler(fs_evt_t const * const evt, fs_ret_t result)
+{
+    if (result != FS_SUCCESS)
+    {
+        // the page stays without header (invalid cache), the bus is searched after reset
+        NRF_LOG_ERROR("ROM code cache: flash operation failed (%d)\r\n", result);
+        this->state = this->isModified ? W1::RomCodeCacheState::Erase : W1::RomCodeCacheState::Idle;
+        return;
+    }
+
+    if (this->state == W1::RomCodeCacheState::Erasing && evt->id == FS_EVT_ERASE)
+    {
+        this->state = this->header[1] ? W1::RomCodeCacheState::StoreAddresses : W1::RomCodeCacheState::StoreHeader;
+    }
+    else if (this->state == W1::RomCodeCacheState::StoringAddresses && evt->id == FS_EVT_STORE)
+    {
+        this->state = W1::RomCodeCacheState::StoreHeader;
+    }
+    else if (this->state == W1::RomCodeCacheState::StoringHeader && evt->id == FS_EVT_STORE && evt->store.p_data == this->header)
+    {
+        NRF_LOG_INFO("ROM code cache stored\r\n");
+        // list changed during the write is written again
+        this->state = this->isModified ? W1::RomCodeCacheState::Erase : W1::RomCodeCacheState::Idle;
+    }
+    else
+    {
+        return;
+    }
+    this->StartOperation();
+}
@@ -0,0 +1,56 @@
+#ifndef ROMCODECACHE_H_3f9a0c7d52e1
+#define ROMCODECACHE_H_3f9a0c7d52e1
+
+#include <cstdint>
+#include "OneWire.h"
+
+extern "C"
+{
+#include "fstorage.h"
+}
+
+namespace W1
+{
+    enum class RomCodeCacheState
+    {
+        Idle,
+        Erase,          // operation waits for DoWork or for free fstorage queue (one operation is queued at a time)
+        Erasing,
+        StoreAddresses,
+        StoringAddresses,
+        StoreHeader,    // header is written last, it marks valid content
+        StoringHeader
+    };
+
+    // Keeps ROM codes of discovered 1-wire devices in a flash page (fstorage), so Search ROM can be skipped after reset.
+    // Page layout (words): [0] magic, [1] device count, [2..] device addresses (2 words per address, lower word first)
+    class RomCodeCache
+    {
+        public:
+            static const uint32_t C_Magic = 0x524F4D31; // "ROM1"
+            static const uint16_t C_HeaderLengthWords = 2;
+            static_assert(C_HeaderLengthWords + 2 * SearchRomHelper::C_maxDeviceCount <= FS_PAGE_SIZE_WORDS, "ROM codes don't fit to one flash page");
+
+            RomCodeCache();
+            uint8_t Load(uint64_t * devices, uint8_t maxCount); // returns number of loaded addresses, 0 = cache is empty or invalid
+            // safe to call from timeslot, the list is copied and written later by DoWork
+            void Store(const uint64_t * devices, uint8_t count);
+            void DoWork(); // call from main loop
+            bool IsBusy();
+            static void FsEventHandlerStatic(fs_evt_t const * const evt, fs_ret_t result);
+
+        private:
+            void FsEventHandler(fs_evt_t const * const evt, fs_ret_t result);
+            void StartOperation();
+            bool IsStored(const uint64_t * devices, uint8_t count);
+
+            volatile RomCodeCacheState state;
+            volatile bool isModified; // list changed by Store, it is written after the running write completes
+            uint32_t header[C_HeaderLengthWords]; // must stay valid until fstorage completes the write
+            uint64_t pendingDevices[SearchRomHelper::C_maxDeviceCount]; // written by Store
+            uint8_t pendingCount;
+            uint64_t devices[SearchRomHelper::C_maxDeviceCount]; // list being written (must stay valid until fstorage completes the write)
+    };
+}
+
+#endif
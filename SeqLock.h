@@ -0,0 +1,71 @@
+#ifndef SEQLOCK_H_8e2b5f19c0d7
+#define SEQLOCK_H_8e2b5f19c0d7
+
+#include <cstdint>
+
+extern "C"
+{
+#include "nrf.h"
+}
+
+// Single writer sequence lock: the writer (higher priority context, e.g. timeslot) never waits, readers (main loop)
+// repeat the copy while a write is in progress or was done during the copy. Sequence is odd while writing.
+template <typename T>
+class SeqLock
+{
+    public:
+        SeqLock() : sequence(0), value()
+        {
+        }
+
+        // in-place update of the protected value, must be followed by EndWrite
+        T & BeginWrite()
+        {
+            this->sequence++;
+            __DMB();
+            return this->value;
+        }
+
+        void EndWrite()
+        {
+            __DMB();
+            this->sequence++;
+        }
+
+        void Read(T & copy) const
+        {
+            uint32_t sequenceBefore;
+            do
+            {
+                sequenceBefore = this->BeginRead();
+                copy = this->value;
+            } while (!this->EndRead(sequenceBefore));
+        }
+
+        // partial read: fields are copied from GetValue between BeginRead and EndRead, copy is repeated while EndRead fails
+        uint32_t BeginRead() const
+        {
+            uint32_t sequence;
+            while ((sequence = this->sequence) & 1)
+                ;
+            __DMB();
+            return sequence;
+        }
+
+        const T & GetValue() const
+        {
+            return this->value;
+        }
+
+        bool EndRead(uint32_t sequence) const
+        {
+            __DMB();
+            return sequence == this->sequence;
+        }
+
+    private:
+        volatile uint32_t sequence;
+        T value;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#include "TemperatureFilter.h"
+
+TemperatureFilter::TemperatureFilter()
+{
+    this->Reset();
+}
+
+void TemperatureFilter::Reset()
+{
+    this->historyCount = 0;
+    this->historyIndex = 0;
+    this->ema = 0;
+    this->output = 0;
+    this->isInitialized = false;
+}
+
+// Median of the last 'length' inputs (insertion sort of a copy, length is at most C_MaxMedianLength)
+int16_t TemperatureFilter::Median(uint8_t length)
+{
+    int16_t sorted[C_MaxMedianLength];
+    uint8_t index = this->historyIndex;
+    for (uint8_t i = 0; i < length; i++)
+    {
+        index = index == 0 ? C_MaxMedianLength - 1 : index - 1;
+        int16_t value = this->history[index];
+        uint8_t j = i;
+        while (j > 0 && sorted[j - 1] > value)
+        {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = value;
+    }
+    return sorted[length >> 1];
+}
+
+int16_t TemperatureFilter::Apply(int16_t temperature, const TemperatureFilterConfig &config)
+{
+    this->history[this->historyIndex] = temperature;
+    this->historyIndex = this->historyIndex + 1 < C_MaxMedianLength ? this->historyIndex + 1 : 0;
+    if (this->historyCount < C_MaxMedianLength)
+    {
+        this->historyCount++;
+    }
+
+    // until the history is filled, median of available inputs is used (odd count)
+    uint8_t medianLength = config.medianLength < this->historyCount ? config.medianLength : this->historyCount;
+    int16_t value = medianLength > 1 ? this->Median(medianLength - !(medianLength & 1)) : temperature;
+
+    if (!this->isInitialized)
+    {
+        this->isInitialized = true;
+        this->ema = static_cast<int32_t>(value) << C_EmaFractionBits;
+        this->output = value;
+        return value;
+    }
+
+    if (config.emaShift)
+    {
+        this->ema += ((static_cast<int32_t>(value) << C_EmaFractionBits) - this->ema) >> config.emaShift;
+        value = (this->ema + (1 << (C_EmaFractionBits - 1))) >> C_EmaFractionBits;
+    }
+
+    if (config.maxStep)
+    {
+        if (value > this->output + config.maxStep)
+        {
+            value = this->output + config.maxStep;
+        }
+        else if (value < this->output - config.maxStep)
+        {
+            value = this->output - config.maxStep;
+        }
+    }
+
+    this->output = value;
+    return value;
+}
+
+bool TemperatureFilter::GetOutput(int16_t &output)
+{
+    if (!this->isInitialized)
+        return false;
+    output = this->output;
+    return true;
+}
+
+TemperatureFilterBank::TemperatureFilterBank(const TemperatureFilterConfig &config) : config(config)
+{
+    for (uint8_t i = 0; i < C_MaxSensors; i++)
+    {
+        this->tags[i] = 0;
+    }
+}
+
+// ROM code: [7:0] family, [55:8] serial number, [63:56] CRC
+uint16_t TemperatureFilterBank::GetTag(uint64_t address)
+{
+    return static_cast<uint16_t>(((address >> 48) & 0xFF00) | ((address >> 8) & 0xFF));
+}
+
+void TemperatureFilterBank::SetConfig(const TemperatureFilterConfig &config)
+{
+    this->config = config;
+}
+
+int16_t TemperatureFilterBank::Apply(uint8_t sensorIndex, uint64_t address, int16_t temperature)
+{
+    if (sensorIndex >= C_MaxSensors)
+        return temperature;
+
+    uint16_t tag = GetTag(address);
+    if (this->tags[sensorIndex] != tag)
+    {
+        this->tags[sensorIndex] = tag;
+        this->filters[sensorIndex].Reset();
+    }
+    return this->filters[sensorIndex].Apply(temperature, this->config);
+}
+
+bool TemperatureFilterBank::GetLast(uint8_t sensorIndex, uint64_t address, int16_t &temperature)
+{
+    if (sensorIndex >= C_MaxSensors || this->tags[sensorIndex] != GetTag(address))
+        return false;
+    return this->filters[sensorIndex].GetOutput(temperature);
+}
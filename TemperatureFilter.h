@@ -0,0 +1,60 @@
+#ifndef TEMPERATUREFILTER_H_c47e2a90b13d
+#define TEMPERATUREFILTER_H_c47e2a90b13d
+
+#include <cstdint>
+#include "app_global.h"
+
+// Stages are applied in order median => EMA => rate limit, all values in 1/256 °C
+struct TemperatureFilterConfig
+{
+    uint8_t medianLength; // spike rejection, 1 = disabled, up to C_MaxMedianLength (odd)
+    uint8_t emaShift;     // exponential moving average with weight 1/2^emaShift, 0 = disabled
+    int16_t maxStep;      // maximal change of output per measurement, 0 = unlimited
+};
+
+// Filter state of one sensor (integer only, no division)
+class TemperatureFilter
+{
+public:
+    static const uint8_t C_MaxMedianLength = 5;
+    static const uint8_t C_EmaFractionBits = 8; // extra fraction bits of EMA accumulator
+
+    TemperatureFilter();
+    void Reset();
+    int16_t Apply(int16_t temperature, const TemperatureFilterConfig &config);
+    bool GetOutput(int16_t &output); // last output, false = nothing filtered since Reset (output is not changed)
+
+private:
+    int16_t Median(uint8_t length);
+
+    int16_t history[C_MaxMedianLength]; // last inputs (ring buffer)
+    uint8_t historyCount;
+    uint8_t historyIndex;
+    int32_t ema; // 1/256 °C << C_EmaFractionBits
+    int16_t output;
+    bool isInitialized;
+};
+
+// Filters of all sensors indexed by the driver sensor index. Indices change when sensors are added or removed, a short tag
+// of the ROM code (CRC and lowest serial number byte) detects another sensor at the index and restarts its filter.
+class TemperatureFilterBank
+{
+public:
+    static const uint8_t C_MaxSensors = ONE_WIRE_MAX_DEVICE_COUNT;
+
+    TemperatureFilterBank(const TemperatureFilterConfig &config);
+    void SetConfig(const TemperatureFilterConfig &config); // all sensors
+    // call once per sensor and measurement cycle with valid readings only
+    int16_t Apply(uint8_t sensorIndex, uint64_t address, int16_t temperature);
+    // last filtered output of the sensor (for invalid readings), false = sensor has no filter (temperature is not changed)
+    bool GetLast(uint8_t sensorIndex, uint64_t address, int16_t &temperature);
+
+private:
+    static uint16_t GetTag(uint64_t address);
+
+    TemperatureFilterConfig config;
+    uint16_t tags[C_MaxSensors];
+    TemperatureFilter filters[C_MaxSensors];
+};
+
+#endif
@@ -2,9 +2,16 @@
 #define APP_GLOBAL_H_8a4f510bcddd7ab
 
 #define ADVERTISING_INTERVAL_MS 1200
-#define MEASUREMENT_INTERVAL_MS 10 * 1000
+#define MEASUREMENT_INTERVAL_MS (10 * 1000)
 #define TIMER_LIB_PRESCALER 0
 #define BLE_GAP_DEVICE_NAME "B001"
 #define BLE_GAP_TX_POWER 4
+#define ONE_WIRE_MAX_DEVICE_COUNT 8 // maximal number of 1-wire devices (sensors), up to 127 (ROM code cache page), limited by RAM (main.cpp)
+#define ONE_WIRE_CRC8_IMPLEMENTATION 256 // CRC-8 variant: 256 = 256 B lookup table, 16 = 16 B nibble table, 0 = bitwise (no table)
+#define ONE_WIRE_TRANSACTION_QUEUE_LENGTH 8 // 1-wire transactions executed back-to-back by the bus
+#define ONE_WIRE_MAX_LANES 1 // maximal number of parallel 1-wire buses (pins) driven in lockstep, up to 8
+#define MEASUREMENT_HISTORY_SIZE ((ONE_WIRE_MAX_DEVICE_COUNT + 2) * 64) // [B] RAM history of readings (64 B blocks), one open block per sensor
+#define FLASH_LOG_PAGE_COUNT 32 // flash pages (1 kB) of the history log, reserved at the top of application flash
+#define CALIBRATION_TABLE_SIZE 8 // sensors with calibration offset (stored in one flash page)
 
 #endif
\ No newline at end of file
@@ -18,6 +18,7 @@ extern "C"
 #include "nrf_sdm.h"
 #include "nrf_drv_adc.h"
 #include "nrf_drv_uart.h"
+#include "fstorage.h"
 
   typedef __uint32_t uint32_t;
   void __cxa_pure_virtual()
@@ -37,10 +38,15 @@ extern "C"
 
 #include "TimeslotManager.h"
 #include "DS18B20.h"
+#include "RomCodeCache.h"
 #include "SupplyBranch.h"
 #include "BleAdvertiser.h"
 #include "SwUart.h"
 #include "StatusLedDriver.h"
+#include "TemperatureFilter.h"
+#include "ReportingPolicy.h"
+#include "MeasurementHistory.h"
+#include "FlashLog.h"
 
 //#define USE_SW_UART_LOGGING
 
@@ -49,6 +55,16 @@ static const uint8_t C_supplyBranchEnPin = 21; // pin enabling high consumption
 static const uint8_t C_blinkPin = 16; // status LED
 
 static const uint8_t C_SwUartLogPin = 23; //SW Uart log (can be same as )
+static const TemperatureFilterConfig C_TemperatureFilterConfig = { 3, 2, 512 }; // median of 3, EMA 1/4, max 2 °C per measurement
+static const uint32_t C_MaxSilentIntervalMs = 5 * 60 * 1000; // advertisement is refreshed at least this often
+static const int32_t C_TemperatureDeadband = 1000;           // [1/10000 °C]
+static const int32_t C_VoltageDeadband = 30;                 // [mV] (advertised resolution)
+static const uint8_t C_HistoryIntervalCycles = 6;            // every N-th measurement is stored to history
+
+// reporting channels
+static const uint8_t C_Temperature1Channel = 0;
+static const uint8_t C_Temperature2Channel = 1;
+static const uint8_t C_VoltageChannel = 2;
 
 void app_error_fault_handler(uint32_t id, uint32_t pc, uint32_t info)
 {
@@ -80,25 +96,47 @@ void app_error_fault_handler(uint32_t id, uint32_t pc, uint32_t info)
 
 static void sys_evt_dispatch(uint32_t evt_id)
 {
+  fs_sys_event_handler(evt_id);
   TS::TimeslotManager::Instance().ProcessSystemEvent(evt_id);
 }
 
 struct AppContext
 {
-  AppContext()
+  AppContext() : temperatureFilter(C_TemperatureFilterConfig), reportingPolicy(C_MaxSilentIntervalMs / MEASUREMENT_INTERVAL_MS)
   {
-    temperatureUpdated = false;
+    reportingPolicy.SetDeadband(C_Temperature1Channel, C_TemperatureDeadband);
+    reportingPolicy.SetDeadband(C_Temperature2Channel, C_TemperatureDeadband);
+    reportingPolicy.SetDeadband(C_VoltageChannel, C_VoltageDeadband);
+    lastCycle = 0;
     swUart = nullptr;
     ds18b20Driver = nullptr;
+    oneWireBus = nullptr;
   }
 
   DS18B20::Driver *ds18b20Driver;
+  W1::OneWireBus *oneWireBus;
   SwUart::Transmitter *swUart;
-  bool temperatureUpdated = false;
+  uint32_t lastCycle; // cycle of the last processed measurement
+  TemperatureFilterBank temperatureFilter;
+  ReportingPolicy reportingPolicy;
+  MeasurementHistory history;
+  FlashLog flashLog;
 };
 
 AppContext appContext;
 
+// Objects scaled by ONE_WIRE_MAX_DEVICE_COUNT have to fit to the RAM left in the 0x1D00 application region after 1 kB stack,
+// 1 kB heap, 2 kB NRF_LOG buffer and about 1.3 kB of fixed SDK and application state (estimate, check the map file)
+static const uint32_t C_SensorRamBudget = 2048;
+static_assert(sizeof(DS18B20::Driver) + sizeof(W1::OneWireBus) + sizeof(W1::RomCodeCache) + sizeof(DS18B20::CalibrationTable) +
+              sizeof(TemperatureFilterBank) + sizeof(MeasurementHistory) <= C_SensorRamBudget, "ONE_WIRE_MAX_DEVICE_COUNT doesn't fit to RAM");
+
+// Block rejected by the log (batch being written) stays in the history ring and is offered again
+static bool OnHistoryBlockSealed(const HistoryBlock &block, void *context)
+{
+  return static_cast<FlashLog *>(context)->Append(block);
+}
+
 void InitSoftdevice()
 {
   // Init
@@ -116,6 +154,10 @@ void InitSoftdevice()
   // Register with the SoftDevice handler module for System events.
   err_code = softdevice_sys_evt_handler_set((sys_evt_handler_t)sys_evt_dispatch);
   APP_ERROR_CHECK(err_code);
+
+  // Flash storage (requires softdevice)
+  err_code = fs_init();
+  APP_ERROR_CHECK(err_code);
   NRF_LOG_INFO("Softdevice initialized\r\n");
   NRF_LOG_FLUSH();
 }
@@ -139,43 +181,93 @@ void InitGap()
 void StartMeasurementHandler(void *p_context)
 {
   NRF_LOG_DEBUG("Start temperature measurement DS18B20 \r\n");
+  // keeps the 24-bit RTC1 extension running even when no conversion starts (no sensors, driver busy)
+  MonotonicClock::Now();
   AppContext *appContext = static_cast<AppContext *>(p_context);
   if (appContext->ds18b20Driver)
   {
     appContext->ds18b20Driver->StartConversion();
-    appContext->temperatureUpdated = false;
   }
 }
 
 void UpdateData(void *p_context)
 {
   AppContext *appContext = static_cast<AppContext *>(p_context);
-  if (appContext->ds18b20Driver && appContext->ds18b20Driver->IsConversionCompleted() & !appContext->temperatureUpdated)
+  if (!appContext->ds18b20Driver)
+    return;
+
+  uint8_t sensorsCount;
+  uint32_t cycleStartTime;
+  uint32_t cycle = appContext->ds18b20Driver->GetSnapshotCycle(sensorsCount, cycleStartTime);
+  if (cycle != appContext->lastCycle)
   {
-    appContext->temperatureUpdated = true;
-    // Update temperature data
+    appContext->lastCycle = cycle;
+    NRF_LOG_INFO("Temperature conversion completed (cycle %d, started %d ms ago) \r\n", cycle,
+                 MonotonicClock::ToMilliseconds(MonotonicClock::Now() - cycleStartTime));
+
+    // Results are read one by one from the driver snapshot (no copy of the whole snapshot), remaining sensors are
+    // skipped if a newer measurement replaced it (processed by the next call)
+    int32_t temperatures[2] = { 0, 0 }; // advertised channels [1/10000 °C]
+    for (uint8_t i = 0; i < sensorsCount; i++)
     {
-      NRF_LOG_INFO("Temperature conversion completed \r\n");
-      uint8_t sensorsCount = appContext->ds18b20Driver->GetSensorsCount();
-      for (uint8_t i = 0; i < sensorsCount; i++)
+      DS18B20::TemperatureInfo info;
+      if (!appContext->ds18b20Driver->GetSnapshotResult(cycle, i, info))
+        break;
+
+      // Filter valid readings, invalid ones keep the last filtered value (raw last valid reading if there is none)
+      if (info.dataValid)
       {
-        uint64_t address = appContext->ds18b20Driver->GetResult()[i].address;
-        uint32_t temperature = appContext->ds18b20Driver->GetResult()[i].temperature;
-        bool isValid = appContext->ds18b20Driver->GetResult()[i].dataValid;
-        NRF_LOG_INFO("  Address (hex): %x %x \r\n", address >> 32, address & 0xFFFFFFFF);
-        NRF_LOG_INFO("  Temperature: %d.%d °C \r\n", temperature / 10000, temperature % 10000);
-        if (isValid)
-        {
-          NRF_LOG_INFO("  OK\r\n");
-        }
-        else
+        info.rawTemperature = appContext->temperatureFilter.Apply(i, info.address, info.rawTemperature);
+        if (cycle % C_HistoryIntervalCycles == 0)
         {
-          NRF_LOG_INFO("  Value is not up to date\r\n");
+          appContext->history.Append(info.address, info.timestamp, info.rawTemperature);
         }
       }
-      int32_t temperature1 = sensorsCount >= 1 ? appContext->ds18b20Driver->GetResult()[0].temperature : 0;
-      int32_t temperature2 = sensorsCount >= 2 ? appContext->ds18b20Driver->GetResult()[1].temperature : 0;
-      BleAdvertiser::Instance().SetTemperature(temperature1, temperature2, -4);
+      else
+      {
+        appContext->temperatureFilter.GetLast(i, info.address, info.rawTemperature);
+      }
+      int32_t temperature = static_cast<int32_t>(info.rawTemperature) * 625 / 16; // 1/256 °C => 1/10000 °C
+      if (i < 2)
+      {
+        temperatures[i] = temperature;
+      }
+
+      NRF_LOG_INFO("  Address (hex): %x %x \r\n", info.address >> 32, info.address & 0xFFFFFFFF);
+      NRF_LOG_INFO("  Temperature: %d.%d °C \r\n", temperature / 10000, temperature % 10000);
+      if (info.dataValid)
+      {
+        NRF_LOG_INFO("  OK\r\n");
+      }
+      else
+      {
+        NRF_LOG_INFO("  Value is not up to date (read %d s ago)\r\n", (MonotonicClock::Now() - info.timestamp) / MonotonicClock::C_TicksPerSecond);
+      }
+    }
+
+    // Update temperature data
+    BleAdvertiser::Instance().SetTemperature(temperatures[0], temperatures[1], -4);
+    appContext->reportingPolicy.Update(C_Temperature1Channel, temperatures[0]);
+    appContext->reportingPolicy.Update(C_Temperature2Channel, temperatures[1]);
+
+    if (appContext->history.GetDroppedCount())
+    {
+      NRF_LOG_WARNING("History blocks not logged to flash: %d\r\n", appContext->history.GetDroppedCount());
+    }
+
+    // Report 1-wire bus faults (probe cable diagnostics)
+    if (appContext->oneWireBus)
+    {
+      const W1::OneWireDiagnostics &diagnostics = appContext->oneWireBus->GetDiagnostics();
+      if (diagnostics.lastFault != W1::OneWireFault::None || diagnostics.slotLowCount)
+      {
+        NRF_LOG_WARNING("1-wire fault %d (resets %d, slot low %d)\r\n", static_cast<int>(diagnostics.lastFault), diagnostics.resetCount, diagnostics.slotLowCount);
+        NRF_LOG_WARNING("  short %d, stuck low %d, slow rise %d, no presence %d\r\n", diagnostics.shortCount, diagnostics.stuckLowCount,
+                        diagnostics.slowRiseCount, diagnostics.noPresenceCount);
+      }
+      NRF_LOG_DEBUG("1-wire rise time: last %d us, max %d us\r\n", diagnostics.lastRiseTimeUs, diagnostics.maxRiseTimeUs);
+      NRF_LOG_DEBUG("1-wire timing: read delay %d us, recovery %d us\r\n", appContext->oneWireBus->GetReadDelayUs(),
+                    appContext->oneWireBus->GetRecoveryTimeUs());
     }
 
     // Update battery voltage
@@ -192,6 +284,7 @@ void UpdateData(void *p_context)
       uint16_t mV = value * (3 * 1200 + 128) / 286;
       NRF_LOG_INFO("ADC Battery voltage. Voltage: %d mV\r\n", mV);
       BleAdvertiser::Instance().SetVoltage(mV);
+      appContext->reportingPolicy.Update(C_VoltageChannel, mV);
     }
 
     //Print temperature from internal temperature sensor
@@ -201,7 +294,13 @@ void UpdateData(void *p_context)
       temp *= 25;
       NRF_LOG_INFO("Internal temperature sensor: %d.%d \r\n", temp / 100, temp % 100);
     }
-    BleAdvertiser::Instance().Update();
+
+    // Advertising restart only if some value changed over its deadband or heartbeat expired
+    if (appContext->reportingPolicy.IsReportDue())
+    {
+      BleAdvertiser::Instance().Update();
+      appContext->reportingPolicy.Reported();
+    }
   }
 }
 
@@ -241,6 +340,8 @@ int main(void)
   //Init soft device
   InitSoftdevice();
   NRF_LOG_FLUSH();
+  appContext.flashLog.Init();
+  appContext.history.SetBlockSealedHandler(OnHistoryBlockSealed, &appContext.flashLog);
 
   //Prepare task scheduler and timer library
   APP_SCHED_INIT(8, 12);
@@ -260,8 +361,16 @@ int main(void)
 
   StatusLedDriver statusLed(highConsumptionBranch.GetHandle(), C_blinkPin);
 
-  W1::OneWireBus oneWireBus(C_oneWireBusPin);
-  DS18B20::Driver driver(TS::TimeslotManager::Instance(), oneWireBus, highConsumptionBranch.GetHandle());
+  // large objects (per-sensor tables, transaction queue, fstorage buffers) are kept off the 1 kB stack
+  static W1::OneWireBus oneWireBus(C_oneWireBusPin);
+  oneWireBus.SetDiagnosticsEnabled(true);
+  appContext.oneWireBus = &oneWireBus;
+  static W1::RomCodeCache romCodeCache;
+  static DS18B20::CalibrationTable calibrationTable;
+  calibrationTable.Load();
+  NRF_LOG_INFO("Calibrated sensors: %u\r\n", calibrationTable.GetCount());
+  static DS18B20::Driver driver(TS::TimeslotManager::Instance(), oneWireBus, highConsumptionBranch.GetHandle(), &romCodeCache, &calibrationTable);
+  driver.SetResolutionPolicy(DS18B20::ResolutionPolicy::Adaptive);
   appContext.ds18b20Driver = &driver;
 
   //disable HW uart and reuse same pin for SW uart
@@ -290,6 +399,10 @@ int main(void)
     NRF_LOG_FLUSH();
 
     TS::TimeslotManager::Instance().DoWork();
+    romCodeCache.DoWork();
+    calibrationTable.DoWork();
+    appContext.history.DoWork();
+    appContext.flashLog.DoWork(driver.IsReady());
     UpdateData(&appContext);
     NRF_LOG_FLUSH();
     sd_app_evt_wait();